@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+
+class AsyncLogger {
+public:
+    enum class Overflow {
+        drop,
+        block
+    };
+
+private:
+    static constexpr std::size_t record_size_ = 248;
+
+    struct alignas(64) Record {
+        std::atomic<std::size_t> sequence{0};
+        std::uint32_t length = 0;
+        std::array<char, record_size_> text;
+    };
+
+    std::unique_ptr<Record[]> ring_;
+    std::size_t mask_;
+    Overflow overflow_;
+    std::ostream& sink_;
+    alignas(64) std::atomic<std::size_t> enqueue_position_{0};
+    alignas(64) std::atomic<std::size_t> dequeue_position_{0};
+    std::atomic<std::size_t> written_position_{0};
+    std::atomic<long long> dropped_{0};
+    std::jthread writer_;
+
+    bool push(const char* text, std::size_t length) {
+        std::size_t position = enqueue_position_.load(std::memory_order_relaxed);
+        Record* record;
+
+        while (true) {
+            record = &ring_[position & mask_];
+            std::size_t sequence = record->sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::ptrdiff_t>(sequence - position);
+
+            if (difference == 0) {
+                if (enqueue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                if (overflow_ == Overflow::drop) {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                std::this_thread::yield();
+                position = enqueue_position_.load(std::memory_order_relaxed);
+            } else {
+                position = enqueue_position_.load(std::memory_order_relaxed);
+            }
+        }
+
+        std::memcpy(record->text.data(), text, length);
+        record->length = static_cast<std::uint32_t>(length);
+        record->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t drain(std::string& batch) {
+        std::size_t position = dequeue_position_.load(std::memory_order_relaxed);
+        std::size_t drained = 0;
+
+        while (true) {
+            Record& record = ring_[position & mask_];
+            if (record.sequence.load(std::memory_order_acquire) != position + 1) {
+                break;
+            }
+
+            batch.append(record.text.data(), record.length);
+            batch.push_back('\n');
+            record.sequence.store(position + mask_ + 1, std::memory_order_release);
+            position++;
+            drained++;
+        }
+
+        dequeue_position_.store(position, std::memory_order_release);
+        return drained;
+    }
+
+    void run(std::stop_token stop) {
+        std::string batch;
+        while (true) {
+            bool stopping = stop.stop_requested();
+            batch.clear();
+
+            if (drain(batch) > 0) {
+                sink_ << batch;
+                sink_.flush();
+                written_position_.store(dequeue_position_.load(std::memory_order_relaxed), std::memory_order_release);
+            } else if (stopping) {
+                return;
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+public:
+    explicit AsyncLogger(std::ostream& sink = std::cout, std::size_t capacity = 4096, Overflow overflow = Overflow::drop)
+        : ring_(std::make_unique<Record[]>(std::bit_ceil(std::max<std::size_t>(2, capacity)))),
+          mask_(std::bit_ceil(std::max<std::size_t>(2, capacity)) - 1),
+          overflow_(overflow),
+          sink_(sink) {
+        for (std::size_t i = 0; i <= mask_; ++i) {
+            ring_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        writer_ = std::jthread([this](std::stop_token stop) {
+            run(stop);
+        });
+    }
+
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+    static AsyncLogger& global() {
+        static AsyncLogger logger;
+        return logger;
+    }
+
+    template<typename... Args>
+    bool log(std::format_string<Args...> fmt, Args&&... args) {
+        thread_local std::array<char, record_size_> buffer;
+        auto result = std::format_to_n(buffer.data(), buffer.size(), fmt, std::forward<Args>(args)...);
+        return push(buffer.data(), std::min<std::size_t>(result.size, buffer.size()));
+    }
+
+    void flush() {
+        std::size_t target = enqueue_position_.load();
+        while (written_position_.load(std::memory_order_acquire) < target) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    long long dropped() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+};
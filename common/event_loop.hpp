@@ -0,0 +1,117 @@
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <queue>
+#include <vector>
+
+class EventLoop {
+public:
+    using Duration = std::chrono::nanoseconds;
+
+    struct Task {
+        struct promise_type {
+            Task get_return_object() {
+                return {std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+
+            std::suspend_always initial_suspend() noexcept {
+                return {};
+            }
+
+            std::suspend_always final_suspend() noexcept {
+                return {};
+            }
+
+            void return_void() {}
+
+            void unhandled_exception() {
+                std::terminate();
+            }
+        };
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+private:
+    struct Event {
+        Duration at;
+        std::uint64_t sequence;
+        std::coroutine_handle<> handle;
+
+        bool operator>(const Event& other) const {
+            return at != other.at ? at > other.at : sequence > other.sequence;
+        }
+    };
+
+    std::priority_queue<Event, std::vector<Event>, std::greater<>> events_;
+    std::vector<std::coroutine_handle<>> tasks_;
+    Duration now_{0};
+    std::uint64_t sequence_ = 0;
+    long long processed_ = 0;
+
+    class Sleep {
+    private:
+        EventLoop& loop_;
+        Duration duration_;
+
+    public:
+        Sleep(EventLoop& loop, Duration duration) : loop_(loop), duration_(duration) {}
+
+        bool await_ready() const noexcept {
+            return duration_ <= Duration::zero();
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            loop_.schedule(loop_.now_ + duration_, handle);
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+public:
+    EventLoop() = default;
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    ~EventLoop() {
+        for (auto task : tasks_) {
+            task.destroy();
+        }
+    }
+
+    Duration now() const {
+        return now_;
+    }
+
+    long long processed() const {
+        return processed_;
+    }
+
+    void spawn(Task task) {
+        tasks_.push_back(task.handle);
+        schedule(now_, task.handle);
+    }
+
+    void schedule(Duration at, std::coroutine_handle<> handle) {
+        events_.push({at, sequence_++, handle});
+    }
+
+    Sleep sleep_for(Duration duration) {
+        return {*this, duration};
+    }
+
+    void run_until(Duration end) {
+        while (!events_.empty() && events_.top().at <= end) {
+            Event event = events_.top();
+            events_.pop();
+            now_ = event.at;
+            processed_++;
+            event.handle.resume();
+        }
+        now_ = end;
+    }
+};
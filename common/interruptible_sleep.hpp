@@ -0,0 +1,16 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stop_token>
+
+inline bool interruptible_sleep(std::stop_token stop, std::chrono::nanoseconds duration) {
+    std::mutex mutex;
+    std::condition_variable_any wakeup;
+    std::unique_lock lock(mutex);
+    wakeup.wait_for(lock, stop, duration, [] {
+        return false;
+    });
+    return !stop.stop_requested();
+}
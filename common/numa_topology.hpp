@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+
+class NumaTopology {
+private:
+    std::vector<std::vector<int>> nodes_;
+    bool virtual_ = false;
+
+    static std::vector<int> parse_cpu_list(const std::string& list) {
+        std::vector<int> cpus;
+        std::size_t position = 0;
+        while (position < list.size()) {
+            std::size_t end = list.find(',', position);
+            std::string range = list.substr(position, end == std::string::npos ? std::string::npos : end - position);
+            std::size_t dash = range.find('-');
+            if (!range.empty() && range != "\n") {
+                int first = std::stoi(range.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                for (int cpu = first; cpu <= last; ++cpu) {
+                    cpus.push_back(cpu);
+                }
+            }
+            if (end == std::string::npos) {
+                break;
+            }
+            position = end + 1;
+        }
+        return cpus;
+    }
+
+    NumaTopology() {
+        for (int node = 0;; ++node) {
+            std::ifstream file(std::format("/sys/devices/system/node/node{}/cpulist", node));
+            std::string list;
+            if (!std::getline(file, list)) {
+                break;
+            }
+            auto cpus = parse_cpu_list(list);
+            if (!cpus.empty()) {
+                nodes_.push_back(std::move(cpus));
+            }
+        }
+
+        if (nodes_.size() < 2) {
+            int cpus_number = std::max(1u, std::thread::hardware_concurrency());
+            nodes_.assign(2, {});
+            for (int cpu = 0; cpu < cpus_number; ++cpu) {
+                nodes_[cpu * 2 / std::max(2, cpus_number)].push_back(cpu);
+            }
+            if (nodes_[1].empty()) {
+                nodes_[1] = nodes_[0];
+            }
+            virtual_ = true;
+        }
+    }
+
+    static int& thread_node() {
+        thread_local int node = -1;
+        return node;
+    }
+
+public:
+    static const NumaTopology& system() {
+        static const NumaTopology topology;
+        return topology;
+    }
+
+    int nodes() const {
+        return static_cast<int>(nodes_.size());
+    }
+
+    bool is_virtual() const {
+        return virtual_;
+    }
+
+    int current_node() const {
+        int& node = thread_node();
+        if (node < 0) {
+            int cpu = sched_getcpu();
+            node = 0;
+            for (int i = 0; i < nodes(); ++i) {
+                if (std::find(nodes_[i].begin(), nodes_[i].end(), cpu) != nodes_[i].end()) {
+                    node = i;
+                    break;
+                }
+            }
+        }
+        return node;
+    }
+
+    void pin_current_thread(int node) const {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : nodes_[node]) {
+            CPU_SET(cpu, &set);
+        }
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        thread_node() = node;
+    }
+};
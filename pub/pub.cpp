@@ -5,92 +5,1096 @@
 #include <chrono>
 #include <mutex>
 #include <format>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <deque>
+#include <queue>
+#include <coroutine>
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <cstdint>
+#include <condition_variable>
+#include <stop_token>
+#include <optional>
+#include <cstring>
+#include <array>
+#include <bit>
+#include <ostream>
+#include <utility>
+#include <tuple>
+#include <cmath>
+#include <sys/resource.h>
+#include <sched.h>
+#include <pthread.h>
+#include <fstream>
+#include <stdexcept>
 
+#include "../common/async_logger.hpp"
+#include "../common/event_loop.hpp"
+#include "../common/interruptible_sleep.hpp"
+#include "../common/numa_topology.hpp"
+
+struct PubScenario {
+    int customers_number = 12;
+    int mugs_number = 4;
+    int taps_number = 2;
+    int drinks_per_customer = 3;
+    std::chrono::milliseconds pour_time{2000};
+    std::chrono::milliseconds drink_time{2000};
+    std::chrono::milliseconds tap_retry{10};
+};
+
+
+class ScalableSemaphore {
+private:
+    struct alignas(64) Shard {
+        std::atomic<long> tokens{0};
+    };
+
+    alignas(64) std::atomic<long> central_;
+    alignas(64) std::atomic<long> maximum_;
+    std::atomic<int> waiters_{0};
+    std::unique_ptr<Shard[]> shards_;
+    int shards_number_;
+    long batch_;
+    std::mutex mutex_;
+    std::condition_variable_any available_;
+
+    Shard& local_shard() {
+        return shards_[static_cast<unsigned>(sched_getcpu()) % shards_number_];
+    }
+
+    static bool take(std::atomic<long>& counter, long wanted, long& taken) {
+        long current = counter.load();
+        while (current > 0) {
+            taken = std::min(current, wanted);
+            if (counter.compare_exchange_weak(current, current - taken)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void wake(bool all = false) {
+        if (waiters_.load() > 0) {
+            { std::scoped_lock lock(mutex_); }
+            if (all) {
+                available_.notify_all();
+            } else {
+                available_.notify_one();
+            }
+        }
+    }
+
+public:
+    explicit ScalableSemaphore(long count, int shards_number = 0, long batch = 8)
+        : central_(count),
+          maximum_(count),
+          shards_(std::make_unique<Shard[]>(std::max(shards_number, 1))),
+          shards_number_(shards_number),
+          batch_(batch) {}
+
+    ScalableSemaphore(const ScalableSemaphore&) = delete;
+    ScalableSemaphore& operator=(const ScalableSemaphore&) = delete;
+
+    bool try_acquire() {
+        long taken = 0;
+        if (shards_number_ == 0) {
+            return take(central_, 1, taken);
+        }
+
+        Shard& shard = local_shard();
+        if (take(shard.tokens, 1, taken)) {
+            return true;
+        }
+        if (take(central_, batch_, taken)) {
+            if (taken > 1) {
+                shard.tokens.fetch_add(taken - 1);
+            }
+            return true;
+        }
+        for (int i = 0; i < shards_number_; ++i) {
+            if (take(shards_[i].tokens, 1, taken)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool acquire(std::stop_token stop = {}) {
+        if (try_acquire()) {
+            return true;
+        }
+
+        std::unique_lock lock(mutex_);
+        ++waiters_;
+        bool acquired = available_.wait(lock, stop, [this] {
+            return try_acquire();
+        });
+        --waiters_;
+        return acquired;
+    }
+
+    void release() {
+        if (shards_number_ == 0 || central_.load(std::memory_order_relaxed) < 0) {
+            central_.fetch_add(1);
+            wake();
+            return;
+        }
+
+        Shard& shard = local_shard();
+        long tokens = shard.tokens.fetch_add(1) + 1;
+        long spilled = 0;
+        if (tokens > 2 * batch_ && take(shard.tokens, batch_, spilled)) {
+            central_.fetch_add(spilled);
+        }
+        wake();
+    }
+
+    void resize(long maximum) {
+        long difference = maximum - maximum_.exchange(maximum);
+        central_.fetch_add(difference);
+        if (difference < 0) {
+            for (int i = 0; i < shards_number_; ++i) {
+                central_.fetch_add(shards_[i].tokens.exchange(0));
+            }
+        }
+        wake(true);
+    }
+
+    long available() const {
+        long total = central_.load();
+        for (int i = 0; i < shards_number_; ++i) {
+            total += shards_[i].tokens.load();
+        }
+        return std::max(total, 0L);
+    }
+
+    long max() const {
+        return maximum_.load();
+    }
+
+    int waiting() const {
+        return waiters_.load(std::memory_order_relaxed);
+    }
+};
+
+class TapPool {
+private:
+    struct Waiter {
+        int tap = -1;
+        bool queued = true;
+        std::binary_semaphore ready{0};
+    };
+
+    std::mutex mutex_;
+    std::deque<int> free_;
+    std::deque<Waiter*> waiters_;
+
+    void cancel(Waiter& waiter) {
+        {
+            std::scoped_lock lock(mutex_);
+            if (!waiter.queued) {
+                return;
+            }
+            waiters_.erase(std::find(waiters_.begin(), waiters_.end(), &waiter));
+            waiter.queued = false;
+        }
+        waiter.ready.release();
+    }
+
+public:
+    explicit TapPool(int taps_number) {
+        for (int i = 0; i < taps_number; ++i) {
+            free_.push_back(i);
+        }
+    }
+
+    std::optional<int> try_acquire() {
+        std::scoped_lock lock(mutex_);
+        if (free_.empty()) {
+            return std::nullopt;
+        }
+        int tap = free_.front();
+        free_.pop_front();
+        return tap;
+    }
+
+    std::optional<int> acquire(std::stop_token stop = {}) {
+        Waiter waiter;
+        {
+            std::scoped_lock lock(mutex_);
+            if (!free_.empty()) {
+                int tap = free_.front();
+                free_.pop_front();
+                return tap;
+            }
+            if (stop.stop_requested()) {
+                return std::nullopt;
+            }
+            waiters_.push_back(&waiter);
+        }
+
+        {
+            std::stop_callback on_stop(stop, [this, &waiter] {
+                cancel(waiter);
+            });
+            waiter.ready.acquire();
+        }
+
+        if (waiter.tap < 0) {
+            return std::nullopt;
+        }
+        return waiter.tap;
+    }
+
+    void release(int tap) {
+        Waiter* next = nullptr;
+        {
+            std::scoped_lock lock(mutex_);
+            if (waiters_.empty()) {
+                free_.push_back(tap);
+                return;
+            }
+            next = waiters_.front();
+            waiters_.pop_front();
+            next->queued = false;
+            next->tap = tap;
+        }
+        next->ready.release();
+    }
+};
+
+class PollingTaps {
+private:
+    std::vector<std::unique_ptr<std::binary_semaphore>> taps_;
+
+public:
+    explicit PollingTaps(int taps_number) {
+        for (int i = 0; i < taps_number; ++i) {
+            taps_.push_back(std::make_unique<std::binary_semaphore>(1));
+        }
+    }
+
+    std::optional<int> acquire(std::stop_token stop = {}) {
+        while (true) {
+            for (int j = 0; j < static_cast<int>(taps_.size()); ++j) {
+                if (taps_[j]->try_acquire()) {
+                    return j;
+                }
+            }
+            if (!interruptible_sleep(stop, PubScenario{}.tap_retry)) {
+                return std::nullopt;
+            }
+        }
+    }
+
+    void release(int tap) {
+        taps_[tap]->release();
+    }
+};
+
+template <typename T>
+class ResourcePool {
+public:
+    class Cache;
+
+private:
+    static constexpr std::uint32_t empty_ = 0xffffffff;
+    static constexpr int slots_ = 64;
+    static constexpr std::size_t cache_share_ = 4;
+
+    enum Source {
+        last_used,
+        same_node,
+        remote_node,
+        stolen,
+        sources
+    };
+
+    struct alignas(64) Stack {
+        std::atomic<std::uint64_t> head{empty_};
+    };
+
+    struct alignas(64) Slot {
+        std::atomic<std::uint32_t> last{empty_};
+        std::array<std::atomic<long>, sources> found{};
+        std::atomic<long> retries{0};
+    };
+
+    std::vector<std::vector<T>> homes_;
+    std::vector<T*> resources_;
+    std::unique_ptr<std::atomic<std::uint32_t>[]> next_;
+    bool affinity_;
+    int nodes_;
+    std::unique_ptr<Stack[]> stacks_;
+    std::unique_ptr<Slot[]> slots_table_;
+    ScalableSemaphore gate_;
+    std::mutex caches_mutex_;
+    std::vector<Cache*> caches_;
+    std::atomic<int> starving_{0};
+
+    static int thread_serial() {
+        static std::atomic<int> next_serial{0};
+        thread_local int serial = next_serial++;
+        return serial;
+    }
+
+    Slot& local_slot() {
+        return slots_table_[thread_serial() % slots_];
+    }
+
+    std::optional<std::uint32_t> pop(Stack& stack, Slot& slot) {
+        std::uint64_t head = stack.head.load();
+        while (true) {
+            std::uint32_t index = static_cast<std::uint32_t>(head);
+            if (index == empty_) {
+                return std::nullopt;
+            }
+            std::uint64_t next = ((head >> 32) + 1) << 32 | next_[index].load(std::memory_order_relaxed);
+            if (stack.head.compare_exchange_weak(head, next)) {
+                return index;
+            }
+            slot.retries.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void push(Stack& stack, std::uint32_t index, Slot& slot) {
+        std::uint64_t head = stack.head.load(std::memory_order_relaxed);
+        next_[index].store(static_cast<std::uint32_t>(head), std::memory_order_relaxed);
+        while (!stack.head.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | index)) {
+            next_[index].store(static_cast<std::uint32_t>(head), std::memory_order_relaxed);
+            slot.retries.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    std::uint32_t take(Slot& slot) {
+        auto found = [&slot](Source source, std::uint32_t index) {
+            slot.found[source].fetch_add(1, std::memory_order_relaxed);
+            return index;
+        };
+
+        if (affinity_) {
+            std::uint32_t index = slot.last.exchange(empty_);
+            if (index != empty_) {
+                return found(last_used, index);
+            }
+        }
+
+        int node = affinity_ ? NumaTopology::system().current_node() % nodes_ : 0;
+        while (true) {
+            for (int k = 0; k < nodes_; ++k) {
+                if (auto index = pop(stacks_[(node + k) % nodes_], slot)) {
+                    return found(k == 0 ? same_node : remote_node, *index);
+                }
+            }
+            for (int i = 0; affinity_ && i < slots_; ++i) {
+                if (slots_table_[i].last.load(std::memory_order_relaxed) != empty_) {
+                    std::uint32_t index = slots_table_[i].last.exchange(empty_);
+                    if (index != empty_) {
+                        return found(stolen, index);
+                    }
+                }
+            }
+        }
+    }
+
+    void give_back(std::uint32_t index) {
+        Slot& slot = local_slot();
+        std::uint32_t expected = empty_;
+        if (!affinity_ || !slot.last.compare_exchange_strong(expected, index)) {
+            push(stacks_[affinity_ ? NumaTopology::system().current_node() % nodes_ : 0], index, slot);
+        }
+        gate_.release();
+    }
+
+    // Each node's share of the resources is moved into storage allocated and first touched by a
+    // thread pinned to that node, and starts on that node's stack.
+    void place(std::vector<T>& resources) {
+        std::size_t count = resources.size();
+        auto first = [&](int node) {
+            return count * node / nodes_;
+        };
+        auto fill = [&](int node) {
+            homes_[node].reserve(first(node + 1) - first(node));
+            for (std::size_t i = first(node); i < first(node + 1); ++i) {
+                homes_[node].push_back(std::move(resources[i]));
+            }
+        };
+
+        homes_.resize(nodes_);
+        const NumaTopology& topology = NumaTopology::system();
+        if (affinity_ && !topology.is_virtual()) {
+            std::vector<std::jthread> placers;
+            for (int node = 0; node < nodes_; ++node) {
+                placers.emplace_back([&, node] {
+                    topology.pin_current_thread(node);
+                    fill(node);
+                });
+            }
+        } else {
+            for (int node = 0; node < nodes_; ++node) {
+                fill(node);
+            }
+        }
+
+        resources_.reserve(count);
+        for (auto& home : homes_) {
+            for (T& resource : home) {
+                resources_.push_back(&resource);
+            }
+        }
+        for (int node = 0; node < nodes_; ++node) {
+            for (std::size_t i = first(node + 1); i-- > first(node);) {
+                push(stacks_[node], static_cast<std::uint32_t>(i), slots_table_[0]);
+            }
+        }
+    }
+
+    // Cached indices keep their gate tokens, so a thread about to block first takes back whatever
+    // the caches hold, and caches stop keeping indices while it waits.
+    std::optional<std::uint32_t> wait_for_index(std::stop_token stop) {
+        if (!gate_.try_acquire()) {
+            starving_.fetch_add(1);
+            reclaim_cached();
+            bool acquired = gate_.acquire(stop);
+            starving_.fetch_sub(1);
+            if (!acquired) {
+                return std::nullopt;
+            }
+        }
+        return take(local_slot());
+    }
+
+    void reclaim_cached() {
+        std::scoped_lock lock(caches_mutex_);
+        for (Cache* cache : caches_) {
+            cache->flush();
+        }
+    }
+
+public:
+    struct AffinityStats {
+        long last_used = 0;
+        long same_node = 0;
+        long remote_node = 0;
+        long stolen = 0;
+        long retries = 0;
+
+        long acquisitions() const {
+            return last_used + same_node + remote_node + stolen;
+        }
+    };
+
+    class Lease {
+    private:
+        ResourcePool* pool_ = nullptr;
+        Cache* cache_ = nullptr;
+        std::uint32_t index_ = 0;
+
+        Lease(ResourcePool* pool, Cache* cache, std::uint32_t index) : pool_(pool), cache_(cache), index_(index) {}
+
+        friend class ResourcePool;
+
+    public:
+        Lease() = default;
+
+        Lease(Lease&& other) noexcept
+            : pool_(std::exchange(other.pool_, nullptr)), cache_(other.cache_), index_(other.index_) {}
+
+        Lease& operator=(Lease&& other) noexcept {
+            if (this != &other) {
+                reset();
+                pool_ = std::exchange(other.pool_, nullptr);
+                cache_ = other.cache_;
+                index_ = other.index_;
+            }
+            return *this;
+        }
+
+        ~Lease() {
+            reset();
+        }
+
+        void reset() {
+            if (!pool_) {
+                return;
+            }
+            if (cache_) {
+                cache_->put(index_);
+            } else {
+                pool_->give_back(index_);
+            }
+            pool_ = nullptr;
+        }
+
+        explicit operator bool() const {
+            return pool_ != nullptr;
+        }
+
+        int index() const {
+            return static_cast<int>(index_);
+        }
+
+        T& operator*() const {
+            return *pool_->resources_[index_];
+        }
+
+        T* operator->() const {
+            return pool_->resources_[index_];
+        }
+    };
+
+    class Cache {
+    private:
+        ResourcePool& pool_;
+        std::size_t capacity_;
+        std::unique_ptr<std::atomic<std::uint32_t>[]> entries_;
+        std::atomic<long> outstanding_{0};
+
+        void put(std::uint32_t index) {
+            outstanding_.fetch_sub(1, std::memory_order_relaxed);
+            for (std::size_t i = 0; i < capacity_; ++i) {
+                std::uint32_t expected = empty_;
+                if (entries_[i].compare_exchange_strong(expected, index)) {
+                    // A waiter that registered after this store either reclaims the entry or is seen here.
+                    if (pool_.starving_.load() > 0 && entries_[i].compare_exchange_strong(index, empty_)) {
+                        pool_.give_back(index);
+                    }
+                    return;
+                }
+            }
+            pool_.give_back(index);
+        }
+
+        void flush() {
+            for (std::size_t i = 0; i < capacity_; ++i) {
+                std::uint32_t index = entries_[i].exchange(empty_);
+                if (index != empty_) {
+                    pool_.give_back(index);
+                }
+            }
+        }
+
+        Lease lease(std::uint32_t index) {
+            outstanding_.fetch_add(1, std::memory_order_relaxed);
+            return Lease(&pool_, this, index);
+        }
+
+        friend class Lease;
+        friend class ResourcePool;
+
+    public:
+        Cache(ResourcePool& pool, std::size_t capacity)
+            : pool_(pool),
+              capacity_(std::min(capacity, std::max<std::size_t>(1, pool.resources_.size() / cache_share_))),
+              entries_(std::make_unique<std::atomic<std::uint32_t>[]>(capacity_)) {
+            for (std::size_t i = 0; i < capacity_; ++i) {
+                entries_[i].store(empty_, std::memory_order_relaxed);
+            }
+            std::scoped_lock lock(pool_.caches_mutex_);
+            pool_.caches_.push_back(this);
+        }
+
+        Cache(const Cache&) = delete;
+        Cache& operator=(const Cache&) = delete;
+
+        // Leases handed out by a cache return through it, so the cache has to outlive them.
+        ~Cache() {
+            if (outstanding_.load() != 0) {
+                std::terminate();
+            }
+            {
+                std::scoped_lock lock(pool_.caches_mutex_);
+                std::erase(pool_.caches_, this);
+            }
+            flush();
+        }
+
+        Lease acquire(std::stop_token stop = {}) {
+            for (std::size_t i = 0; i < capacity_; ++i) {
+                if (entries_[i].load(std::memory_order_relaxed) != empty_) {
+                    std::uint32_t index = entries_[i].exchange(empty_);
+                    if (index != empty_) {
+                        return lease(index);
+                    }
+                }
+            }
+            if (auto index = pool_.wait_for_index(stop)) {
+                return lease(*index);
+            }
+            return {};
+        }
+    };
+
+    explicit ResourcePool(std::vector<T> resources, bool affinity = true)
+        : next_(std::make_unique<std::atomic<std::uint32_t>[]>(resources.size())),
+          affinity_(affinity),
+          nodes_(affinity ? NumaTopology::system().nodes() : 1),
+          stacks_(std::make_unique<Stack[]>(nodes_)),
+          slots_table_(std::make_unique<Slot[]>(slots_)),
+          gate_(static_cast<long>(resources.size())) {
+        place(resources);
+    }
+
+    ResourcePool(const ResourcePool&) = delete;
+    ResourcePool& operator=(const ResourcePool&) = delete;
+
+    Lease try_acquire() {
+        if (gate_.try_acquire()) {
+            return Lease(this, nullptr, take(local_slot()));
+        }
+        return {};
+    }
+
+    Lease acquire(std::stop_token stop = {}) {
+        if (auto index = wait_for_index(stop)) {
+            return Lease(this, nullptr, *index);
+        }
+        return {};
+    }
+
+    int capacity() const {
+        return static_cast<int>(resources_.size());
+    }
+
+    AffinityStats affinity_stats() const {
+        AffinityStats stats;
+        for (int i = 0; i < slots_; ++i) {
+            const Slot& slot = slots_table_[i];
+            stats.last_used += slot.found[last_used].load(std::memory_order_relaxed);
+            stats.same_node += slot.found[same_node].load(std::memory_order_relaxed);
+            stats.remote_node += slot.found[remote_node].load(std::memory_order_relaxed);
+            stats.stolen += slot.found[stolen].load(std::memory_order_relaxed);
+            stats.retries += slot.retries.load(std::memory_order_relaxed);
+        }
+        return stats;
+    }
+};
+
+template <typename T>
+using Lease = typename ResourcePool<T>::Lease;
+
+struct Mug {
+    int id;
+};
+
+struct Tap {
+    int id;
+};
+
+template <typename T>
+std::vector<T> numbered(int count) {
+    std::vector<T> resources;
+    for (int i = 0; i < count; ++i) {
+        resources.push_back(T{i});
+    }
+    return resources;
+}
+
+template <typename... T>
+std::optional<std::tuple<Lease<T>...>> acquire_all(std::stop_token stop, ResourcePool<T>&... pools) {
+    std::tuple<Lease<T>...> leases;
+    auto each = [&](auto&& f) {
+        [&]<std::size_t... I>(std::index_sequence<I...>) {
+            (f(I, std::get<I>(std::tie(pools...)), std::get<I>(leases)), ...);
+        }(std::index_sequence_for<T...>{});
+    };
+
+    std::size_t missing = sizeof...(T);
+    while (true) {
+        bool cancelled = false;
+        each([&](std::size_t i, auto& pool, auto& lease) {
+            if (i == missing) {
+                lease = pool.acquire(stop);
+                cancelled = !lease;
+            }
+        });
+        if (cancelled) {
+            return std::nullopt;
+        }
+
+        missing = sizeof...(T);
+        each([&](std::size_t i, auto& pool, auto& lease) {
+            if (missing == sizeof...(T) && !lease && !(lease = pool.try_acquire())) {
+                missing = i;
+            }
+        });
+        if (missing == sizeof...(T)) {
+            return leases;
+        }
+
+        each([](std::size_t, auto&, auto& lease) {
+            lease.reset();
+        });
+    }
+}
+
+class TokenBucket {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::chrono::nanoseconds interval_;
+    std::chrono::nanoseconds tolerance_;
+    std::atomic<std::int64_t> theoretical_arrival_{0};
+
+public:
+    TokenBucket(double rate_per_second, int burst)
+        : interval_(static_cast<std::int64_t>(1e9 / validated_rate(rate_per_second))),
+          tolerance_(interval_ * (validated_burst(burst) - 1)) {}
+
+    static double validated_rate(double rate_per_second) {
+        if (!(rate_per_second > 0) || !std::isfinite(rate_per_second)) {
+            throw std::invalid_argument("TokenBucket: rate_per_second must be positive and finite");
+        }
+        return rate_per_second;
+    }
+
+    static int validated_burst(int burst) {
+        if (burst < 1) {
+            throw std::invalid_argument("TokenBucket: burst must be at least 1");
+        }
+        return burst;
+    }
+
+    bool try_take(Clock::time_point now = Clock::now()) {
+        std::int64_t arrival = now.time_since_epoch().count();
+        std::int64_t expected = theoretical_arrival_.load(std::memory_order_relaxed);
+        while (true) {
+            std::int64_t start = std::max(expected, arrival);
+            if (start - arrival > tolerance_.count()) {
+                return false;
+            }
+            if (theoretical_arrival_.compare_exchange_weak(expected, start + interval_.count(), std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+};
+
+class CoDel {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::chrono::nanoseconds target_;
+    std::chrono::nanoseconds interval_;
+    std::mutex mutex_;
+    std::optional<Clock::time_point> first_above_;
+    bool dropping_ = false;
+    int drops_ = 0;
+    Clock::time_point drop_next_;
+
+    Clock::time_point control_law(Clock::time_point now) const {
+        return now + std::chrono::duration_cast<std::chrono::nanoseconds>(interval_ / std::sqrt(static_cast<double>(drops_)));
+    }
+
+public:
+    CoDel(std::chrono::nanoseconds target, std::chrono::nanoseconds interval) : target_(target), interval_(interval) {}
+
+    bool should_drop(std::chrono::nanoseconds sojourn, Clock::time_point now = Clock::now()) {
+        std::scoped_lock lock(mutex_);
+        if (sojourn < target_) {
+            first_above_.reset();
+            dropping_ = false;
+            return false;
+        }
+        if (!first_above_) {
+            first_above_ = now + interval_;
+            return false;
+        }
+        if (now < *first_above_) {
+            return false;
+        }
+        if (!dropping_) {
+            dropping_ = true;
+            drops_ = 1;
+            drop_next_ = control_law(now);
+            return true;
+        }
+        if (now >= drop_next_) {
+            ++drops_;
+            drop_next_ = control_law(now);
+            return true;
+        }
+        return false;
+    }
+};
+
+// Orders waiting callers: a Turn is granted only after every earlier Turn on the same line has
+// ended, so the caller holding it is the only one waiting on whatever the line guards.
+class FifoLine {
+private:
+    struct Waiter {
+        std::condition_variable_any turn;
+        bool head = false;
+    };
+
+    std::mutex mutex_;
+    std::deque<Waiter*> line_;
+
+    bool wait_turn(Waiter& waiter, std::stop_token stop) {
+        std::unique_lock lock(mutex_);
+        line_.push_back(&waiter);
+        waiter.head = line_.size() == 1;
+        bool turn = waiter.turn.wait(lock, stop, [&waiter] {
+            return waiter.head;
+        });
+        if (!turn) {
+            std::erase(line_, &waiter);
+        }
+        return turn;
+    }
+
+    void pass_turn() {
+        std::scoped_lock lock(mutex_);
+        line_.pop_front();
+        if (!line_.empty()) {
+            line_.front()->head = true;
+            line_.front()->turn.notify_one();
+        }
+    }
+
+public:
+    class Turn {
+    private:
+        FifoLine* line_ = nullptr;
+        Waiter waiter_;
+
+    public:
+        Turn(FifoLine& line, std::stop_token stop) {
+            if (line.wait_turn(waiter_, stop)) {
+                line_ = &line;
+            }
+        }
+
+        Turn(const Turn&) = delete;
+        Turn& operator=(const Turn&) = delete;
+
+        ~Turn() {
+            if (line_) {
+                line_->pass_turn();
+            }
+        }
+
+        explicit operator bool() const {
+            return line_ != nullptr;
+        }
+    };
+};
+
+enum class Admission {
+    admitted,
+    rate_limited,
+    queue_full,
+    shed,
+    cancelled
+};
+
+template <typename T>
+class AdmissionControl {
+public:
+    struct Limits {
+        double rate_per_second;
+        int burst;
+        int max_queue;
+        std::chrono::nanoseconds target_delay;
+        std::chrono::nanoseconds interval;
+    };
+
+    struct Result {
+        Admission admission;
+        Lease<T> lease;
+        std::chrono::nanoseconds queue_delay{0};
+    };
+
+private:
+
+    ResourcePool<T>& pool_;
+    TokenBucket bucket_;
+    CoDel codel_;
+    int max_queue_;
+    std::atomic<int> queued_{0};
+    std::array<std::atomic<long>, 5> outcomes_{};
+    FifoLine line_;
+
+    Result finish(Admission admission, Lease<T> lease = {}, std::chrono::nanoseconds queue_delay = {}) {
+        outcomes_[static_cast<int>(admission)].fetch_add(1, std::memory_order_relaxed);
+        return {admission, std::move(lease), queue_delay};
+    }
+
+public:
+    AdmissionControl(ResourcePool<T>& pool, const Limits& limits)
+        : pool_(pool),
+          bucket_(limits.rate_per_second, limits.burst),
+          codel_(limits.target_delay, limits.interval),
+          max_queue_(limits.max_queue) {}
+
+    Result acquire(std::stop_token stop = {}) {
+        auto arrived = std::chrono::steady_clock::now();
+        if (!bucket_.try_take(arrived)) {
+            return finish(Admission::rate_limited);
+        }
+
+        int ahead = queued_.fetch_add(1);
+        if (ahead >= max_queue_) {
+            --queued_;
+            return finish(Admission::queue_full);
+        }
+        if (ahead == 0) {
+            if (auto lease = pool_.try_acquire()) {
+                --queued_;
+                return finish(Admission::admitted, std::move(lease));
+            }
+        }
+
+        // Only the head of line_ waits on the pool, so new arrivals cannot overtake queued requests.
+        Lease<T> lease;
+        if (FifoLine::Turn turn(line_, stop); turn) {
+            lease = pool_.acquire(stop);
+        }
+        --queued_;
+        if (!lease) {
+            return finish(Admission::cancelled);
+        }
+
+        auto dequeued = std::chrono::steady_clock::now();
+        auto sojourn = std::chrono::duration_cast<std::chrono::nanoseconds>(dequeued - arrived);
+        if (codel_.should_drop(sojourn, dequeued)) {
+            return finish(Admission::shed, {}, sojourn);
+        }
+        return finish(Admission::admitted, std::move(lease), sojourn);
+    }
+
+    long outcomes(Admission admission) const {
+        return outcomes_[static_cast<int>(admission)].load(std::memory_order_relaxed);
+    }
+
+    int queued() const {
+        return queued_.load(std::memory_order_relaxed);
+    }
+};
+
+enum class Acquisition {
+    hold_and_wait,
+    atomic
+};
 
 class Pub {
 private:
     const int total_mugs_; 
     const int total_taps_; 
 
-    std::vector<std::unique_ptr<std::binary_semaphore>> taps_; 
+    ResourcePool<Tap> taps_; 
     std::atomic<int> current_mugs_available_;
-    static constexpr int mug_max_ = 100; 
-    std::counting_semaphore<mug_max_> mugs_;
+    ResourcePool<Mug> mugs_;
     std::vector<bool> tap_in_use_;
-    std::mutex io_mutex_;
+    Acquisition acquisition_;
+    PubScenario scenario_;
+    bool verbose_;
+    // Customers wait on the pools one at a time in arrival order, so a freed mug or tap goes to
+    // the longest-waiting customer. Under atomic acquisition mug_line_ orders the pair.
+    FifoLine mug_line_;
+    FifoLine tap_line_;
+
+    std::optional<std::pair<Lease<Mug>, Lease<Tap>>> take_mug_and_tap(int customer_id, std::stop_token stop) {
+        if (acquisition_ == Acquisition::atomic) {
+            std::optional<std::tuple<Lease<Mug>, Lease<Tap>>> leases;
+            if (FifoLine::Turn turn(mug_line_, stop); turn) {
+                leases = acquire_all(stop, mugs_, taps_);
+            }
+            if (!leases) {
+                return std::nullopt;
+            }
+            --current_mugs_available_;
+            log("Customer {} takes mug {} and tap {}.", customer_id, std::get<0>(*leases)->id, std::get<1>(*leases)->id);
+            return std::pair(std::move(std::get<0>(*leases)), std::move(std::get<1>(*leases)));
+        }
+
+        Lease<Mug> mug;
+        if (FifoLine::Turn turn(mug_line_, stop); turn) {
+            mug = mugs_.acquire(stop);
+        }
+        if (!mug) {
+            return std::nullopt;
+        }
+        --current_mugs_available_;
+        log("Customer {} takes mug {}.", customer_id, mug->id);
+
+        Lease<Tap> tap;
+        if (FifoLine::Turn turn(tap_line_, stop); turn) {
+            tap = taps_.acquire(stop);
+        }
+        if (!tap) {
+            mug.reset();
+            ++current_mugs_available_;
+            return std::nullopt;
+        }
+        return std::pair(std::move(mug), std::move(tap));
+    }
 
 public:
-    Pub(int mugs_number, int taps_number)
-        : mugs_(mugs_number),
+    Pub(int mugs_number, int taps_number, Acquisition acquisition = Acquisition::atomic,
+        const PubScenario& scenario = {}, bool verbose = true)
+        : mugs_(numbered<Mug>(mugs_number)),
           total_mugs_(mugs_number), 
           total_taps_(taps_number),
-          current_mugs_available_(mugs_number) 
+          taps_(numbered<Tap>(taps_number)),
+          current_mugs_available_(mugs_number),
+          acquisition_(acquisition),
+          scenario_(scenario),
+          verbose_(verbose)
     {
-        taps_.reserve(total_taps_);
         tap_in_use_.resize(total_taps_, false);
-        for (int i = 0; i < total_taps_; ++i) {
-            taps_.push_back(std::make_unique<std::binary_semaphore>(1));
-        }
     }
 
-    void drink(int customer_id, int drinks_required) {
+    void drink(int customer_id, int drinks_required, std::stop_token stop = {}) {
         for (int i = 0; i < drinks_required; ++i) {
-            mugs_.acquire();
-            --current_mugs_available_;
-      
-            log(std::format("Customer {} takes a mug.", customer_id));
+            auto taken = take_mug_and_tap(customer_id, stop);
+            if (!taken) {
+                break;
+            }
+            auto& [mug, tap] = *taken;
             
-            int used_tap = -1;
-            while (used_tap == -1) {
-                
-                for (int j = 0; j < total_taps_; ++j) {
-                    if (taps_[j]->try_acquire()) {
-                        used_tap = j;
-
-                        tap_in_use_[used_tap] = true;
-
-                        break;
-                    }
-                }
+            tap_in_use_[tap->id] = true;
+            log("Customer {} pours a beer from tap {}", customer_id, tap->id);
+            bool poured = interruptible_sleep(stop, scenario_.pour_time);
+            tap_in_use_[tap->id] = false;
+            tap.reset();
 
-                if (used_tap == -1) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
-                }
+            if (poured) {
+                log("Customer {} is drinking.", customer_id);
+                interruptible_sleep(stop, scenario_.drink_time);
             }
 
-            log(std::format("Customer {} pours a beer from tap {}", customer_id, used_tap));
-            std::this_thread::sleep_for(std::chrono::milliseconds(2000));
-            taps_[used_tap]->release();
-
-            log(std::format("Customer {} is drinking.", customer_id));
-            std::this_thread::sleep_for(std::chrono::milliseconds(2000));
-
-            mugs_.release();
+            mug.reset();
             ++current_mugs_available_;
-            tap_in_use_[used_tap] = false;
-            log(std::format("Customer {} puts down the mug.", customer_id));
+            log("Customer {} puts down the mug.", customer_id);
         }
 
-        log(std::format("Customer {} leaves the pub.", customer_id));
+        log("Customer {} leaves the pub.", customer_id);
     }
 
-    void log(const std::string& message) {
-        std::scoped_lock lock(io_mutex_);
-        std::cout << message << std::endl;
+    template<typename... Args>
+    void log(std::format_string<Args...> fmt, Args&&... args) {
+        if (verbose_) {
+            AsyncLogger::global().log(fmt, std::forward<Args>(args)...);
+        }
     }
 
     void verify_and_close_pub(int initial_mugs_number, int final_mugs_number) {    
         if (final_mugs_number == initial_mugs_number) {
-            log(std::format("\nAll mugs returned properly! Start: {}, End: {}.", initial_mugs_number, final_mugs_number));
+            log("\nAll mugs returned properly! Start: {}, End: {}.", initial_mugs_number, final_mugs_number);
         } else {
-            log(std::format("\nMug count mismatch! Start: {}, End: {}", initial_mugs_number, final_mugs_number));
+            log("\nMug count mismatch! Start: {}, End: {}", initial_mugs_number, final_mugs_number);
         }
 
         for (int i = 0; i < total_taps_; ++i) {
             if (!tap_in_use_[i]) {
-                log(std::format("Tap {} was used correctly.", i));
+                log("Tap {} was used correctly.", i);
             } else {
-                log(std::format("Tap {} usage error detected!", i));
+                log("Tap {} usage error detected!", i);
             }
         }
     }
@@ -103,7 +1107,8 @@ public:
         return total_mugs_;
     }
 
-    void simulate(int customers_number, int drinks_per_customer); 
+    std::optional<std::chrono::microseconds> simulate(int customers_number, int drinks_per_customer,
+                                                      std::optional<std::chrono::milliseconds> closing_time = std::nullopt); 
 };
 
 
@@ -117,32 +1122,668 @@ public:
     Customer(int id, Pub& pub, int drinks_required) 
         : customer_id_(id), pub_(pub), drinks_required_(drinks_required) {}
 
-    void operator()() {
-        pub_.drink(customer_id_, drinks_required_);
+    void operator()(std::stop_token stop) {
+        pub_.drink(customer_id_, drinks_required_, stop);
     }
 };
 
-void Pub::simulate(int customers_number, int drinks_per_customer) {
+std::optional<std::chrono::microseconds> Pub::simulate(int customers_number, int drinks_per_customer,
+                                                        std::optional<std::chrono::milliseconds> closing_time) {
     int initial_mugs_number = total_mugs_;
+    std::optional<std::chrono::microseconds> shutdown;
 
     {
         std::vector<std::jthread> customer_threads;
         for (int i = 0; i < customers_number; ++i) {
             customer_threads.emplace_back(Customer(i, *this, drinks_per_customer));
         }
+
+        if (closing_time) {
+            std::this_thread::sleep_for(*closing_time);
+            auto closed_at = std::chrono::steady_clock::now();
+            log("The pub is closing.");
+
+            for (auto& t : customer_threads) {
+                t.request_stop();
+            }
+            customer_threads.clear();
+
+            shutdown = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - closed_at);
+            log("All customers left {} us after closing.", shutdown->count());
+        }
+
+        for (auto& t : customer_threads) {
+            t.join();
+        }
     }
 
     int final_mugs_number = mugs_remaining();
     verify_and_close_pub(initial_mugs_number, final_mugs_number);
+    return shutdown;
+}
+
+
+class VirtualPub {
+public:
+    struct Stats {
+        long long drinks = 0;
+        EventLoop::Duration mug_wait{0};
+        EventLoop::Duration tap_wait{0};
+        EventLoop::Duration closing_time{0};
+
+        double average_ms(EventLoop::Duration total) const {
+            return drinks ? std::chrono::duration<double, std::milli>(total).count() / drinks : 0.0;
+        }
+    };
+
+private:
+    EventLoop& loop_;
+    Acquisition acquisition_;
+    int mugs_available_;
+    std::deque<std::coroutine_handle<>> mug_waiters_;
+    std::deque<int> free_taps_;
+    std::deque<std::pair<std::coroutine_handle<>, int*>> tap_waiters_;
+    std::deque<std::pair<std::coroutine_handle<>, int*>> pair_waiters_;
+    Stats stats_;
+
+    void serve_pair_waiters() {
+        while (!pair_waiters_.empty() && mugs_available_ > 0 && !free_taps_.empty()) {
+            auto [waiter, slot] = pair_waiters_.front();
+            pair_waiters_.pop_front();
+            mugs_available_--;
+            *slot = free_taps_.front();
+            free_taps_.pop_front();
+            loop_.schedule(loop_.now(), waiter);
+        }
+    }
+
+    class AcquireMug {
+    private:
+        VirtualPub& pub_;
+
+    public:
+        explicit AcquireMug(VirtualPub& pub) : pub_(pub) {}
+
+        bool await_ready() {
+            if (pub_.mugs_available_ > 0 && pub_.mug_waiters_.empty()) {
+                pub_.mugs_available_--;
+                return true;
+            }
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            pub_.mug_waiters_.push_back(handle);
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    class AcquireTap {
+    private:
+        VirtualPub& pub_;
+        int tap_ = -1;
+
+    public:
+        explicit AcquireTap(VirtualPub& pub) : pub_(pub) {}
+
+        bool await_ready() {
+            if (pub_.free_taps_.empty()) {
+                return false;
+            }
+            tap_ = pub_.free_taps_.front();
+            pub_.free_taps_.pop_front();
+            return true;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            pub_.tap_waiters_.emplace_back(handle, &tap_);
+        }
+
+        int await_resume() const noexcept {
+            return tap_;
+        }
+    };
+
+    class AcquireMugAndTap {
+    private:
+        VirtualPub& pub_;
+        int tap_ = -1;
+
+    public:
+        explicit AcquireMugAndTap(VirtualPub& pub) : pub_(pub) {}
+
+        bool await_ready() {
+            if (pub_.mugs_available_ == 0 || pub_.free_taps_.empty() || !pub_.pair_waiters_.empty()) {
+                return false;
+            }
+            pub_.mugs_available_--;
+            tap_ = pub_.free_taps_.front();
+            pub_.free_taps_.pop_front();
+            return true;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            pub_.pair_waiters_.emplace_back(handle, &tap_);
+        }
+
+        int await_resume() const noexcept {
+            return tap_;
+        }
+    };
+
+public:
+    VirtualPub(EventLoop& loop, int mugs_number, int taps_number, Acquisition acquisition = Acquisition::atomic)
+        : loop_(loop), acquisition_(acquisition), mugs_available_(mugs_number) {
+        for (int i = 0; i < taps_number; ++i) {
+            free_taps_.push_back(i);
+        }
+    }
+
+    Acquisition acquisition() const {
+        return acquisition_;
+    }
+
+    AcquireMug take_mug() {
+        return AcquireMug(*this);
+    }
+
+    AcquireMugAndTap take_mug_and_tap() {
+        return AcquireMugAndTap(*this);
+    }
+
+    void put_down_mug() {
+        if (acquisition_ == Acquisition::atomic) {
+            mugs_available_++;
+            serve_pair_waiters();
+            return;
+        }
+        if (mug_waiters_.empty()) {
+            mugs_available_++;
+            return;
+        }
+        loop_.schedule(loop_.now(), mug_waiters_.front());
+        mug_waiters_.pop_front();
+    }
+
+    AcquireTap take_tap() {
+        return AcquireTap(*this);
+    }
+
+    void release_tap(int tap) {
+        if (acquisition_ == Acquisition::atomic) {
+            free_taps_.push_back(tap);
+            serve_pair_waiters();
+            return;
+        }
+        if (tap_waiters_.empty()) {
+            free_taps_.push_back(tap);
+            return;
+        }
+        auto [waiter, slot] = tap_waiters_.front();
+        tap_waiters_.pop_front();
+        *slot = tap;
+        loop_.schedule(loop_.now(), waiter);
+    }
+
+    void record_drink(EventLoop::Duration mug_wait, EventLoop::Duration tap_wait) {
+        stats_.drinks++;
+        stats_.mug_wait += mug_wait;
+        stats_.tap_wait += tap_wait;
+        stats_.closing_time = std::max(stats_.closing_time, loop_.now());
+    }
+
+    const Stats& stats() const {
+        return stats_;
+    }
+};
+
+EventLoop::Task virtual_customer(EventLoop& loop, VirtualPub& pub, PubScenario scenario) {
+    for (int i = 0; i < scenario.drinks_per_customer; ++i) {
+        auto arrived = loop.now();
+        int used_tap = -1;
+        if (pub.acquisition() == Acquisition::atomic) {
+            used_tap = co_await pub.take_mug_and_tap();
+        } else {
+            co_await pub.take_mug();
+        }
+        auto mug_taken = loop.now();
+
+        if (used_tap < 0) {
+            used_tap = co_await pub.take_tap();
+        }
+        auto tap_taken = loop.now();
+
+        co_await loop.sleep_for(scenario.pour_time);
+        pub.release_tap(used_tap);
+
+        co_await loop.sleep_for(scenario.drink_time);
+        pub.put_down_mug();
+        pub.record_drink(mug_taken - arrived, tap_taken - mug_taken);
+    }
+}
+
+struct VirtualRun {
+    PubScenario scenario;
+    Acquisition acquisition;
+    VirtualPub::Stats stats;
+    long long events;
+};
+
+VirtualRun simulate_virtual(const PubScenario& scenario, Acquisition acquisition) {
+    EventLoop loop;
+    VirtualPub pub(loop, scenario.mugs_number, scenario.taps_number, acquisition);
+
+    for (int i = 0; i < scenario.customers_number; ++i) {
+        loop.spawn(virtual_customer(loop, pub, scenario));
+    }
+
+    loop.run_until(EventLoop::Duration::max());
+    return {scenario, acquisition, pub.stats(), loop.processed()};
+}
+
+void sweep_virtual() {
+    std::vector<std::pair<PubScenario, Acquisition>> scenarios;
+    for (int customers_number : {12, 100, 1000}) {
+        for (int mugs_number : {2, 4, 8, 16}) {
+            for (int taps_number : {1, 2, 4}) {
+                for (Acquisition acquisition : {Acquisition::hold_and_wait, Acquisition::atomic}) {
+                    PubScenario scenario;
+                    scenario.customers_number = customers_number;
+                    scenario.mugs_number = mugs_number;
+                    scenario.taps_number = taps_number;
+                    scenarios.emplace_back(scenario, acquisition);
+                }
+            }
+        }
+    }
+
+    std::vector<VirtualRun> runs(scenarios.size());
+    std::atomic<std::size_t> next{0};
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::jthread> workers;
+        for (unsigned t = 0; t < std::max(1u, std::thread::hardware_concurrency()); ++t) {
+            workers.emplace_back([&] {
+                for (std::size_t i = next++; i < scenarios.size(); i = next++) {
+                    runs[i] = simulate_virtual(scenarios[i].first, scenarios[i].second);
+                }
+            });
+        }
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (const auto& run : runs) {
+        std::cout << std::format("customers: {:>4} | mugs: {:>2} | taps: {} | {:<13} | drinks: {:>4} | mug wait avg {:>9.1f} ms | tap wait avg {:>8.1f} ms | closing time {:>8.1f} s | events: {}\n",
+                                 run.scenario.customers_number, run.scenario.mugs_number, run.scenario.taps_number,
+                                 run.acquisition == Acquisition::atomic ? "atomic" : "hold-and-wait",
+                                 run.stats.drinks, run.stats.average_ms(run.stats.mug_wait), run.stats.average_ms(run.stats.tap_wait),
+                                 std::chrono::duration<double>(run.stats.closing_time).count(), run.events);
+    }
+    std::cout << std::format("{} scenarios simulated in {:.3f} s\n", runs.size(), elapsed);
+}
+
+struct TapBenchmark {
+    std::vector<double> waits_us;
+    double elapsed_s;
+    double cpu_s;
+};
+
+double cpu_seconds() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+template <typename Taps>
+TapBenchmark measure_taps(int taps_number, int threads_number, int pours, std::chrono::microseconds pour_time) {
+    Taps taps(taps_number);
+    std::vector<std::vector<double>> waits(threads_number);
+
+    double cpu_start = cpu_seconds();
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::jthread> threads;
+        for (int t = 0; t < threads_number; ++t) {
+            threads.emplace_back([&, t] {
+                waits[t].reserve(pours);
+                for (int i = 0; i < pours; ++i) {
+                    auto arrived = std::chrono::steady_clock::now();
+                    int tap = *taps.acquire();
+                    waits[t].push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - arrived).count());
+                    std::this_thread::sleep_for(pour_time);
+                    taps.release(tap);
+                }
+            });
+        }
+    }
+    TapBenchmark result;
+    result.elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.cpu_s = cpu_seconds() - cpu_start;
+    for (auto& w : waits) {
+        result.waits_us.insert(result.waits_us.end(), w.begin(), w.end());
+    }
+    std::sort(result.waits_us.begin(), result.waits_us.end());
+    return result;
+}
+
+void benchmark_taps() {
+    const int taps_number = PubScenario{}.taps_number;
+    const int pours = 200;
+    const std::chrono::microseconds pour_time(500);
+
+    auto percentile = [](const std::vector<double>& sorted, double p) {
+        return sorted.empty() ? 0.0 : sorted[static_cast<std::size_t>(p * (sorted.size() - 1))];
+    };
+
+    for (int threads_number : {2, 4, 8, 16}) {
+        auto report = [&](const char* name, const TapBenchmark& run) {
+            std::cout << std::format("{:<8} | threads: {:>2} | wait p50 {:>9.1f} us | p99 {:>9.1f} us | max {:>9.1f} us | {:>8.0f} pours/s | cpu {:.3f} s\n",
+                                     name, threads_number, percentile(run.waits_us, 0.5), percentile(run.waits_us, 0.99),
+                                     percentile(run.waits_us, 1.0), run.waits_us.size() / run.elapsed_s, run.cpu_s);
+        };
+        report("polling", measure_taps<PollingTaps>(taps_number, threads_number, pours, pour_time));
+        report("pool", measure_taps<TapPool>(taps_number, threads_number, pours, pour_time));
+    }
+}
+
+template <typename Cycle>
+double measure_pool(int threads_number, int cycles_per_thread, Cycle cycle) {
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::jthread> threads;
+        for (int t = 0; t < threads_number; ++t) {
+            threads.emplace_back([&] {
+                cycle(cycles_per_thread);
+            });
+        }
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return threads_number * cycles_per_thread / elapsed / 1e6;
+}
+
+void benchmark_pool() {
+    const int resources_number = 32;
+    const int total_cycles = 1 << 21;
+
+    for (int threads_number : {1, 2, 4, 8, 16, 32, 64, 128}) {
+        int cycles = total_cycles / threads_number;
+
+        TapPool locked(resources_number);
+        double locked_rate = measure_pool(threads_number, cycles, [&](int n) {
+            for (int i = 0; i < n; ++i) {
+                locked.release(*locked.acquire());
+            }
+        });
+
+        ResourcePool<Tap> shared(numbered<Tap>(resources_number));
+        double shared_rate = measure_pool(threads_number, cycles, [&](int n) {
+            for (int i = 0; i < n; ++i) {
+                Lease<Tap> lease = shared.acquire();
+            }
+        });
+
+        ResourcePool<Tap> cached(numbered<Tap>(resources_number));
+        double cached_rate = measure_pool(threads_number, cycles, [&](int n) {
+            ResourcePool<Tap>::Cache cache(cached, 4);
+            for (int i = 0; i < n; ++i) {
+                Lease<Tap> lease = cache.acquire();
+            }
+        });
+
+        std::cout << std::format("threads: {:>3} | mutex free list {:>7.2f} M/s | lock-free pool {:>7.2f} M/s | cached pool {:>7.2f} M/s\n",
+                                 threads_number, locked_rate, shared_rate, cached_rate);
+    }
+}
+
+void benchmark_acquisition() {
+    PubScenario scenario;
+    scenario.pour_time = std::chrono::milliseconds(20);
+    scenario.drink_time = std::chrono::milliseconds(20);
+    scenario.drinks_per_customer = 10;
+
+    for (int mugs_number : {2, 4, 8}) {
+        for (int taps_number : {1, 2, 4}) {
+            auto measure = [&](Acquisition acquisition) {
+                Pub pub(mugs_number, taps_number, acquisition, scenario, false);
+                auto start = std::chrono::steady_clock::now();
+                pub.simulate(scenario.customers_number, scenario.drinks_per_customer);
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                return scenario.customers_number * scenario.drinks_per_customer / elapsed;
+            };
+            double hold_and_wait = measure(Acquisition::hold_and_wait);
+            double atomic = measure(Acquisition::atomic);
+            std::cout << std::format("mugs: {} | taps: {} | hold-and-wait {:>6.1f} drinks/s | atomic {:>6.1f} drinks/s | {:+.1f}%\n",
+                                     mugs_number, taps_number, hold_and_wait, atomic, (atomic / hold_and_wait - 1) * 100);
+        }
+    }
+}
+
+template <typename Semaphore>
+double measure_semaphore(Semaphore& semaphore, int threads_number, int cycles_per_thread) {
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::jthread> threads;
+        for (int t = 0; t < threads_number; ++t) {
+            threads.emplace_back([&] {
+                for (int i = 0; i < cycles_per_thread; ++i) {
+                    semaphore.acquire();
+                    semaphore.release();
+                }
+            });
+        }
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return threads_number * cycles_per_thread / elapsed / 1e6;
+}
+
+void benchmark_semaphore() {
+    const int total_cycles = 1 << 22;
+    const int shards_number = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    for (int threads_number : {1, 2, 4, 8, 16, 32, 64, 128}) {
+        int cycles = total_cycles / threads_number;
+        std::counting_semaphore<> standard(threads_number);
+        ScalableSemaphore central(threads_number);
+        ScalableSemaphore sharded(threads_number, shards_number);
+        double standard_rate = measure_semaphore(standard, threads_number, cycles);
+        double central_rate = measure_semaphore(central, threads_number, cycles);
+        double sharded_rate = measure_semaphore(sharded, threads_number, cycles);
+        std::cout << std::format("threads: {:>3} | counting_semaphore {:>7.2f} M/s | central {:>7.2f} M/s | sharded ({} shards) {:>7.2f} M/s\n",
+                                 threads_number, standard_rate, central_rate, shards_number, sharded_rate);
+    }
+
+    ScalableSemaphore mugs(100, shards_number);
+    std::atomic<int> holding{0};
+    std::atomic<int> peak{0};
+    std::stop_source closing;
+    {
+        std::vector<std::jthread> customers;
+        for (int i = 0; i < 1000; ++i) {
+            customers.emplace_back([&] {
+                if (!mugs.acquire(closing.get_token())) {
+                    return;
+                }
+                int now = ++holding;
+                for (int seen = peak.load(); seen < now && !peak.compare_exchange_weak(seen, now);) {}
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                --holding;
+                mugs.release();
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        mugs.resize(1000);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        mugs.resize(10);
+        closing.request_stop();
+    }
+    std::cout << std::format("resized 100 -> 1000 -> 10 mugs: peak holders {}, available after shrink {}\n",
+                             peak.load(), mugs.available());
+}
+
+struct Buffer {
+    int id;
+    std::array<char, 4096> data{};
+};
+
+void benchmark_affinity() {
+    const int total_cycles = 1 << 18;
+
+    // With 32 buffers every thread keeps its own; with 8 buffers held across a yield, threads
+    // outnumber buffers and the ones without a last-used buffer have to steal one.
+    for (auto [buffers_number, hold] : {std::pair(32, false), std::pair(8, true)}) {
+        std::cout << std::format("buffers: {} | {}\n", buffers_number, hold ? "held across a yield" : "released immediately");
+        for (int threads_number : {1, 2, 4, 8, 16, 32, 64}) {
+            int cycles = total_cycles / threads_number;
+            auto measure = [&](bool affinity) {
+                ResourcePool<Buffer> buffers(numbered<Buffer>(buffers_number), affinity);
+                auto start = std::chrono::steady_clock::now();
+                {
+                    std::vector<std::jthread> threads;
+                    for (int t = 0; t < threads_number; ++t) {
+                        threads.emplace_back([&, t] {
+                            NumaTopology::system().pin_current_thread(t % NumaTopology::system().nodes());
+                            for (int i = 0; i < cycles; ++i) {
+                                Lease<Buffer> buffer = buffers.acquire();
+                                std::memset(buffer->data.data(), i, buffer->data.size());
+                                if (hold) {
+                                    std::this_thread::yield();
+                                }
+                            }
+                        });
+                    }
+                }
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                return std::pair(threads_number * cycles / elapsed / 1e6, buffers.affinity_stats());
+            };
+
+            auto [global_rate, global_stats] = measure(false);
+            auto [affine_rate, affine_stats] = measure(true);
+            double total = std::max(1L, affine_stats.acquisitions());
+            std::cout << std::format("threads: {:>2} | global {:>6.2f} M/s, {:.3f} retries/op | affinity {:>6.2f} M/s, {:.3f} retries/op | "
+                                     "last used {:>5.1f}% | same node {:>5.1f}% | remote {:>5.1f}% | stolen {:>5.1f}%\n",
+                                     threads_number, global_rate, static_cast<double>(global_stats.retries) / std::max(1L, global_stats.acquisitions()),
+                                     affine_rate, affine_stats.retries / total,
+                                     100 * affine_stats.last_used / total, 100 * affine_stats.same_node / total,
+                                     100 * affine_stats.remote_node / total, 100 * affine_stats.stolen / total);
+        }
+    }
+}
+
+void benchmark_admission() {
+    const int mugs_number = PubScenario{}.mugs_number;
+    const std::chrono::milliseconds service_time(2);
+    const std::chrono::milliseconds run_time(300);
+    const double capacity = mugs_number * 1000.0 / service_time.count();
+
+    AdmissionControl<Mug>::Limits limits{capacity * 1.2, 20, 4 * mugs_number,
+                                        std::chrono::milliseconds(5), std::chrono::milliseconds(50)};
+
+    auto percentile = [](std::vector<double>& values, double p) {
+        if (values.empty()) {
+            return 0.0;
+        }
+        std::sort(values.begin(), values.end());
+        return values[static_cast<std::size_t>(p * (values.size() - 1))];
+    };
+
+    for (double load : {0.5, 0.8, 1.0, 1.2, 1.5, 2.0, 3.0}) {
+        auto run = [&](bool controlled) {
+            ResourcePool<Mug> mugs(numbered<Mug>(mugs_number));
+            AdmissionControl<Mug> admission(mugs, limits);
+            std::mutex delays_mutex;
+            std::vector<double> delays;
+            std::atomic<long> served{0};
+
+            auto interval = std::chrono::nanoseconds(static_cast<std::int64_t>(1e9 / (capacity * load)));
+            auto start = std::chrono::steady_clock::now();
+            {
+                std::vector<std::jthread> customers;
+                for (auto arrival = start; arrival < start + run_time; arrival += interval) {
+                    std::this_thread::sleep_until(arrival);
+                    customers.emplace_back([&] {
+                        auto arrived = std::chrono::steady_clock::now();
+                        Lease<Mug> mug;
+                        if (controlled) {
+                            mug = admission.acquire().lease;
+                        } else {
+                            mug = mugs.acquire();
+                        }
+                        if (!mug) {
+                            return;
+                        }
+                        double delay = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - arrived).count();
+                        std::this_thread::sleep_for(service_time);
+                        ++served;
+                        std::scoped_lock lock(delays_mutex);
+                        delays.push_back(delay);
+                    });
+                }
+            }
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            long rejected = admission.outcomes(Admission::rate_limited) + admission.outcomes(Admission::queue_full) +
+                            admission.outcomes(Admission::shed);
+            return std::format("p50 {:>7.2f} ms | p99 {:>7.2f} ms | goodput {:>5.0f}/s | rejected {:>4}",
+                               percentile(delays, 0.5), percentile(delays, 0.99), served / elapsed, rejected);
+        };
+
+        std::cout << std::format("offered {:>4.1f}x ({:>5.0f}/s) | unbounded: {} | admission control: {}\n",
+                                 load, capacity * load, run(false), run(true));
+    }
 }
 
+int main(int argc, char* argv[]) {
+    std::string mode = argc > 1 ? argv[1] : "";
 
-int main() {
+    if (mode == "admission") {
+        benchmark_admission();
+        return 0;
+    }
+
+    if (mode == "affinity") {
+        benchmark_affinity();
+        return 0;
+    }
+
+    if (mode == "semaphore") {
+        benchmark_semaphore();
+        return 0;
+    }
+
+    if (mode == "acquisition") {
+        benchmark_acquisition();
+        return 0;
+    }
+
+    if (mode == "pool") {
+        benchmark_pool();
+        return 0;
+    }
+
+    if (mode == "taps") {
+        benchmark_taps();
+        return 0;
+    }
+
+    if (mode == "virtual") {
+        sweep_virtual();
+        return 0;
+    }
+
+    if (mode == "closing") {
+        const int customers_number = 50;
+        const std::chrono::milliseconds closing_time(3000);
+
+        Pub pub(PubScenario{}.mugs_number, PubScenario{}.taps_number);
+        std::cout << std::format("Customers: {}, closing after {} ms\n\n", customers_number, closing_time.count());
+        pub.simulate(customers_number, PubScenario{}.drinks_per_customer, closing_time);
+        return 0;
+    }
 
-    const int customers_number = 12;   
-    const int mugs_number = 4;      
-    const int taps_number = 2;        
-    const int drinks_per_customer = 3;  
+    const int customers_number = PubScenario{}.customers_number;   
+    const int mugs_number = PubScenario{}.mugs_number;      
+    const int taps_number = PubScenario{}.taps_number;        
+    const int drinks_per_customer = PubScenario{}.drinks_per_customer;  
 
     Pub pub(mugs_number, taps_number);  
 
@@ -2,14 +2,78 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <stop_token>
 #include <vector>
 #include <chrono>
 #include <random>
 #include <format>
 #include <deque>
+#include <set>
+#include <cstring>
+#include <ostream>
+#include <streambuf>
+#include <semaphore>
+#include <atomic>
+#include <array>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <bit>
+#include <climits>
+#include <optional>
+#include <numeric>
+#include <coroutine>
+#include <latch>
+#include <span>
+#include <shared_mutex>
+#include <functional>
+#include <queue>
+#include <map>
+#include <tuple>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <cerrno>
+#include <ctime>
+#include <new>
+#include <system_error>
+#include <type_traits>
+#include <fstream>
+#include <utility>
+#include <sched.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/post.hpp>
+
+#include "../common/async_logger.hpp"
+#include "../common/event_loop.hpp"
+#include "../common/interruptible_sleep.hpp"
+#include "../common/numa_topology.hpp"
 
 class Library;
 
+struct LibraryScenario {
+    int readers_number = 3;
+    int writers_number = 9;
+    std::chrono::milliseconds read_time{400};
+    std::chrono::milliseconds write_time{600};
+    std::chrono::milliseconds reader_pause_min{200};
+    std::chrono::milliseconds reader_pause_max{500};
+    std::chrono::milliseconds writer_pause_min{2000};
+    std::chrono::milliseconds writer_pause_max{3000};
+};
+
 class Reader {
 private:
     int id_; 
@@ -30,166 +94,3667 @@ public:
     void operator()(std::stop_token stop); 
 };
 
+enum class WritePriority {
+    critical,
+    normal,
+    bulk
+};
+
+enum class WaitMode {
+    park,
+    spin,
+    adaptive
+};
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+template<typename Ready>
+bool spin_until(Ready ready, std::chrono::nanoseconds budget) {
+    if (budget <= std::chrono::nanoseconds::zero()) {
+        return ready();
+    }
+
+    constexpr int max_backoff = 64;
+    auto deadline = std::chrono::steady_clock::now() + budget;
+    int backoff = 1;
+
+    while (!ready()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        for (int i = 0; i < backoff; ++i) {
+            cpu_relax();
+        }
+        backoff = std::min(backoff * 2, max_backoff);
+    }
+    return true;
+}
+
+class CohortRwLock {
+private:
+    struct alignas(64) NodeLock {
+        std::atomic<std::uint32_t> next_ticket{0};
+        std::atomic<std::uint32_t> now_serving{0};
+        bool owns_global = false;
+        int batch = 0;
+    };
+
+    struct alignas(64) ReaderIndicator {
+        std::atomic<long> readers{0};
+    };
+
+    std::vector<NodeLock> node_locks_;
+    std::vector<ReaderIndicator> indicators_;
+    alignas(64) std::atomic<bool> global_{false};
+    alignas(64) std::atomic<bool> writer_{false};
+    alignas(64) std::atomic<int> writers_waiting_{0};
+    int owner_node_ = 0;
+    int max_batch_;
+    std::atomic<long long> acquisitions_{0};
+    std::atomic<long long> migrations_{0};
+    std::atomic<long long> local_handoffs_{0};
+
+    template<typename Ready>
+    static void wait_until(Ready ready) {
+        for (int spins = 0; !ready(); ++spins) {
+            if (spins < 128) {
+                cpu_relax();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    int node_index() const {
+        return NumaTopology::system().current_node() % static_cast<int>(node_locks_.size());
+    }
+
+    bool readers_present() const {
+        return std::any_of(indicators_.begin(), indicators_.end(), [](const ReaderIndicator& indicator) {
+            return indicator.readers.load() != 0;
+        });
+    }
+
+public:
+    explicit CohortRwLock(int nodes = NumaTopology::system().nodes(), int max_batch = 64)
+        : node_locks_(std::max(1, nodes)), indicators_(std::max(1, nodes)), max_batch_(max_batch) {}
+
+    void lock_shared() {
+        auto& readers = indicators_[node_index()].readers;
+        while (true) {
+            wait_until([this] {
+                return !writer_.load(std::memory_order_relaxed) && writers_waiting_.load(std::memory_order_relaxed) == 0;
+            });
+
+            readers.fetch_add(1);
+            if (!writer_.load() && writers_waiting_.load() == 0) {
+                return;
+            }
+            readers.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    void unlock_shared() {
+        indicators_[node_index()].readers.fetch_sub(1, std::memory_order_release);
+    }
+
+    void lock() {
+        int node = node_index();
+        NodeLock& local = node_locks_[node];
+        writers_waiting_.fetch_add(1);
+
+        std::uint32_t ticket = local.next_ticket.fetch_add(1, std::memory_order_relaxed);
+        wait_until([&] {
+            return local.now_serving.load(std::memory_order_acquire) == ticket;
+        });
+
+        if (!local.owns_global) {
+            wait_until([this] {
+                bool expected = false;
+                return !global_.load(std::memory_order_relaxed) &&
+                       global_.compare_exchange_weak(expected, true, std::memory_order_acquire);
+            });
+            migrations_.fetch_add(1, std::memory_order_relaxed);
+            local.batch = 0;
+        }
+
+        owner_node_ = node;
+        acquisitions_.fetch_add(1, std::memory_order_relaxed);
+        writer_.store(true);
+        writers_waiting_.fetch_sub(1, std::memory_order_relaxed);
+        wait_until([this] {
+            return !readers_present();
+        });
+    }
+
+    void unlock() {
+        NodeLock& local = node_locks_[owner_node_];
+        bool local_waiters = local.next_ticket.load(std::memory_order_relaxed) - local.now_serving.load(std::memory_order_relaxed) > 1;
+
+        if (local_waiters && ++local.batch < max_batch_) {
+            local.owns_global = true;
+            local_handoffs_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            local.owns_global = false;
+            writer_.store(false, std::memory_order_release);
+            global_.store(false, std::memory_order_release);
+        }
+        local.now_serving.fetch_add(1, std::memory_order_release);
+    }
+
+    double average_batch() const {
+        long long migrations = migrations_.load();
+        return migrations ? static_cast<double>(migrations + local_handoffs_.load()) / migrations : 0.0;
+    }
+};
+
+class LatencyHistogram {
+private:
+    static constexpr int sub_bucket_bits_ = 4;
+    static constexpr int sub_buckets_ = 1 << sub_bucket_bits_;
+    static constexpr int buckets_ = 64 * sub_buckets_;
+
+    std::array<long long, buckets_> counts_{};
+    long long total_ = 0;
+
+    static int index_of(std::uint64_t ns) {
+        if (ns < sub_buckets_) {
+            return static_cast<int>(ns);
+        }
+        int exponent = std::bit_width(ns) - 1;
+        int sub = static_cast<int>(ns >> (exponent - sub_bucket_bits_)) & (sub_buckets_ - 1);
+        return (exponent - sub_bucket_bits_ + 1) * sub_buckets_ + sub;
+    }
+
+    static std::uint64_t value_of(int index) {
+        if (index < sub_buckets_) {
+            return index;
+        }
+        int exponent = index / sub_buckets_ + sub_bucket_bits_ - 1;
+        int sub = index % sub_buckets_;
+        return static_cast<std::uint64_t>(sub_buckets_ + sub) << (exponent - sub_bucket_bits_);
+    }
+
+public:
+    void record(std::uint64_t ns) {
+        counts_[index_of(ns)]++;
+        total_++;
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (int i = 0; i < buckets_; ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+    }
+
+    long long count() const {
+        return total_;
+    }
+
+    std::uint64_t percentile(double p) const {
+        long long rank = static_cast<long long>(p / 100.0 * total_);
+        long long seen = 0;
+        for (int i = 0; i < buckets_; ++i) {
+            seen += counts_[i];
+            if (seen > rank) {
+                return value_of(i);
+            }
+        }
+        return 0;
+    }
+
+    void print(const std::string& name) const {
+        std::cout << std::format("{} | samples: {} | p50: {} ns | p99: {} ns | p99.9: {} ns\n",
+                                 name, total_, percentile(50.0), percentile(99.0), percentile(99.9));
+
+        std::array<long long, 65> rows{};
+        for (int i = 0; i < buckets_; ++i) {
+            rows[std::bit_width(value_of(i))] += counts_[i];
+        }
+
+        long long peak = *std::max_element(rows.begin(), rows.end());
+        for (int row = 0; row < 65; ++row) {
+            if (rows[row] == 0) {
+                continue;
+            }
+            std::uint64_t low = row == 0 ? 0 : 1ull << (row - 1);
+            std::cout << std::format("  [{:>10} ns, {:>10} ns) {:>10} {}\n", low, 1ull << row, rows[row],
+                                     std::string(40 * rows[row] / peak, '#'));
+        }
+    }
+};
+
+#ifndef LIBRARY_PROFILING
+#define LIBRARY_PROFILING 0
+#endif
+
+#if LIBRARY_PROFILING
+class LockProfiler {
+public:
+    enum class Role {
+        reader,
+        writer
+    };
+
+private:
+    struct alignas(64) ThreadProfile {
+        Role role;
+        int id;
+        std::thread::id thread;
+        std::uint64_t acquired_at = 0;
+        LatencyHistogram wait{};
+        LatencyHistogram hold{};
+        LatencyHistogram handoff{};
+        LatencyHistogram queue_depth{};
+    };
+
+    struct Row {
+        LatencyHistogram wait{};
+        LatencyHistogram hold{};
+        LatencyHistogram handoff{};
+        LatencyHistogram queue_depth{};
+
+        void merge(const ThreadProfile& profile) {
+            wait.merge(profile.wait);
+            hold.merge(profile.hold);
+            handoff.merge(profile.handoff);
+            queue_depth.merge(profile.queue_depth);
+        }
+    };
+
+    static inline std::atomic<std::uint64_t> instances_{0};
+
+    std::uint64_t instance_ = instances_.fetch_add(1) + 1;
+    std::uint64_t started_ticks_ = now();
+    std::chrono::steady_clock::time_point started_at_ = std::chrono::steady_clock::now();
+    mutable std::mutex registry_mutex_;
+    std::map<std::tuple<std::thread::id, Role, int>, std::unique_ptr<ThreadProfile>> profiles_;
+
+    ThreadProfile& profile(Role role, int id) {
+        struct Cache {
+            std::uint64_t instance = 0;
+            int id;
+            ThreadProfile* profile;
+        };
+        thread_local std::array<Cache, 2> caches{};
+
+        Cache& cache = caches[static_cast<int>(role)];
+        if (cache.instance == instance_ && cache.id == id) {
+            return *cache.profile;
+        }
+
+        std::scoped_lock lock(registry_mutex_);
+        auto& profile = profiles_[{std::this_thread::get_id(), role, id}];
+        if (!profile) {
+            profile = std::make_unique<ThreadProfile>(ThreadProfile{role, id, std::this_thread::get_id()});
+        }
+
+        cache = {instance_, id, profile.get()};
+        return *profile;
+    }
+
+    static void print_row(const std::string& name, const Row& row, double ns_per_tick) {
+        auto ns = [ns_per_tick](const LatencyHistogram& histogram, double p) {
+            return static_cast<std::uint64_t>(histogram.percentile(p) * ns_per_tick);
+        };
+
+        std::cout << std::format("{:<10} | acquisitions: {:>8} | wait p50/p99: {:>9}/{:>9} ns | hold p50/p99: {:>9}/{:>9} ns | queue p50/p99: {:>3}/{:>3}",
+                                 name, row.wait.count(), ns(row.wait, 50.0), ns(row.wait, 99.0),
+                                 ns(row.hold, 50.0), ns(row.hold, 99.0),
+                                 row.queue_depth.percentile(50.0), row.queue_depth.percentile(99.0));
+        if (row.handoff.count() > 0) {
+            std::cout << std::format(" | handoff p50/p99: {:>7}/{:>7} ns", ns(row.handoff, 50.0), ns(row.handoff, 99.0));
+        }
+        std::cout << '\n';
+    }
+
+public:
+    static std::uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    void record_wait(Role role, int id, std::uint64_t arrived, std::size_t queue_depth) {
+        ThreadProfile& p = profile(role, id);
+        p.acquired_at = now();
+        p.wait.record(p.acquired_at - arrived);
+        p.queue_depth.record(queue_depth);
+    }
+
+    void record_handoff(Role role, int id, std::uint64_t granted) {
+        profile(role, id).handoff.record(now() - granted);
+    }
+
+    void record_release(Role role, int id) {
+        ThreadProfile& p = profile(role, id);
+        if (p.acquired_at != 0) {
+            p.hold.record(now() - p.acquired_at);
+            p.acquired_at = 0;
+        }
+    }
+
+    void report() const {
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started_at_).count();
+        double ns_per_tick = elapsed > 0 ? static_cast<double>(elapsed) / (now() - started_ticks_) : 1.0;
+
+        std::scoped_lock lock(registry_mutex_);
+        std::cout << "\n--- Lock profile ---\n";
+
+        for (Role role : {Role::reader, Role::writer}) {
+            std::string name = role == Role::reader ? "reader" : "writer";
+
+            std::vector<int> ids;
+            Row total;
+            for (const auto& [key, p] : profiles_) {
+                if (p->role == role) {
+                    ids.push_back(p->id);
+                    total.merge(*p);
+                }
+            }
+            if (ids.empty()) {
+                continue;
+            }
+
+            print_row(name + "s", total, ns_per_tick);
+
+            std::sort(ids.begin(), ids.end());
+            ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+            for (int id : ids) {
+                Row row;
+                for (const auto& [key, p] : profiles_) {
+                    if (p->role == role && p->id == id) {
+                        row.merge(*p);
+                    }
+                }
+                print_row(std::format("  {} {}", name, id), row, ns_per_tick);
+            }
+        }
+    }
+};
+#else
+class LockProfiler {
+public:
+    enum class Role {
+        reader,
+        writer
+    };
+
+    static std::uint64_t now() {
+        return 0;
+    }
+
+    void record_wait(Role, int, std::uint64_t, std::size_t) {}
+    void record_release(Role, int) {}
+    void report() const {}
+};
+#endif
+
 class Library {
+public:
+    using Deadline = std::chrono::steady_clock::time_point;
+
 private:
+    enum class NodeState {
+        waiting,
+        parked,
+        granted,
+        cancelled
+    };
+
+    struct WriterNode {
+        int id;
+        WritePriority priority;
+        Deadline due;
+        std::uint64_t sequence;
+        bool queued = false;
+        std::binary_semaphore granted{0};
+        std::atomic<NodeState> state{NodeState::waiting};
+        std::chrono::steady_clock::time_point granted_at{};
+#if LIBRARY_PROFILING
+        std::uint64_t granted_ticks = 0;
+#endif
+    };
+
+    enum class CombineState : std::uint32_t {
+        idle,
+        pending,
+        applying,
+        applied,
+        combine
+    };
+
+    struct alignas(64) CombiningSlot {
+        std::atomic<bool> owned{false};
+        std::atomic<CombineState> state{CombineState::idle};
+        void (*apply)(void*) = nullptr;
+        void* operation = nullptr;
+    };
+
+    struct EarliestDue {
+        bool operator()(const WriterNode* a, const WriterNode* b) const {
+            return a->due != b->due ? a->due < b->due : a->sequence < b->sequence;
+        }
+    };
+
+    static constexpr std::array<std::chrono::milliseconds, 3> write_budgets_{
+        std::chrono::milliseconds(0), std::chrono::milliseconds(10), std::chrono::milliseconds(200)};
+    static constexpr std::chrono::milliseconds read_budget_{10};
+    static constexpr int combining_slots_number_ = 64;
+    static constexpr int combining_passes_ = 3;
+    static constexpr int combining_spins_ = 256;
+    static constexpr std::chrono::nanoseconds min_spin_{500};
+    static constexpr std::chrono::nanoseconds max_spin_{20000};
+
     int readers_ = 0;     
     int writers_ = 0;        
     int waiting_writers_ = 0;  
+    std::array<int, 3> waiting_by_priority_{};
     int waiting_readers_ = 0;
-    std::condition_variable cond_readers_; 
-    std::condition_variable cond_writers_;  
+    bool readers_turn_ = false;
+    std::chrono::steady_clock::time_point readers_waiting_since_{};
+    int waiting_upgraders_ = 0;
+    bool upgrader_ = false;
+    bool upgrading_ = false;
+    std::condition_variable_any cond_readers_; 
+    std::condition_variable_any cond_upgraders_;
+    std::condition_variable_any cond_upgrade_;
     std::mutex mutex_; 
-    std::mutex io_mutex_; 
-    std::deque<int> writers_queue_;
+    std::set<WriterNode*, EarliestDue> writers_queue_;
+    std::uint64_t writers_sequence_ = 0;
+    bool verbose_;
+    std::atomic<long long> handoffs_{0};
+    std::atomic<long long> handoff_ns_{0};
+    WaitMode wait_mode_;
+    std::atomic<bool> readers_blocked_{false};
+    std::atomic<std::int64_t> read_hold_ns_{0};
+    std::atomic<std::int64_t> write_hold_ns_{0};
+    std::chrono::steady_clock::time_point write_acquired_at_{};
+    std::array<CombiningSlot, combining_slots_number_> combining_slots_;
+    std::atomic<bool> combining_{false};
+    std::atomic<long long> combined_batches_{0};
+    std::atomic<long long> combined_operations_{0};
+    [[no_unique_address]] LockProfiler profiler_;
 
-public:
-    void start_read(int id) {
-        std::unique_lock lock(mutex_);
-        waiting_readers_++;
+    static std::chrono::steady_clock::time_point& read_acquired_at() {
+        thread_local std::chrono::steady_clock::time_point acquired_at{};
+        return acquired_at;
+    }
 
-        cond_readers_.wait(lock, [this] {
-            return writers_ == 0 && waiting_writers_ == 0; 
-        });
+    void update_reader_hint() {
+        readers_blocked_.store(!can_read(), std::memory_order_relaxed);
+    }
 
-        waiting_readers_--;
-        readers_++;
+    bool can_read() const {
+        return writers_ == 0 && !upgrading_ && (readers_turn_ || !urgent_writer_waiting());
+    }
 
+    // Readers queued behind writers for longer than read_budget_ get the next turn, so a steady
+    // stream of writers cannot starve them.
+    bool readers_overdue() const {
+        return waiting_readers_ > 0 && std::chrono::steady_clock::now() - readers_waiting_since_ >= read_budget_;
+    }
+
+    bool urgent_writer_waiting() const {
+        if (writers_queue_.empty()) {
+            return false;
+        }
+        if (waiting_by_priority_[static_cast<int>(WritePriority::critical)] > 0 ||
+            waiting_by_priority_[static_cast<int>(WritePriority::normal)] > 0) {
+            return true;
+        }
+        return (*writers_queue_.begin())->due <= std::chrono::steady_clock::now();
+    }
+
+    // A queued writer turns urgent once its due time passes without any release to announce it,
+    // so blocked readers bound their wait by the head's due time and re-check.
+    std::optional<Deadline> read_recheck_at(std::optional<Deadline> deadline) const {
+        if (writers_queue_.empty()) {
+            return deadline;
+        }
+        Deadline due = (*writers_queue_.begin())->due;
+        if (due <= std::chrono::steady_clock::now() || (deadline && *deadline < due)) {
+            return deadline;
+        }
+        return due;
+    }
+
+    bool can_write() const {
+        return readers_ == 0 && writers_ == 0 && !upgrader_ && !(readers_turn_ && waiting_readers_ > 0);
+    }
+
+    void wake_readers() {
+        if (!can_read()) {
+            return;
+        }
         if (waiting_readers_ > 0) {
-            cond_readers_.notify_one(); 
+            cond_readers_.notify_all();
+        }
+        if (waiting_upgraders_ > 0) {
+            cond_upgraders_.notify_one();
+        }
+    }
+
+    WriterNode* grant_next_writer() {
+        if (!can_write() || writers_queue_.empty()) {
+            return nullptr;
         }
 
-        log(std::format("Reader {} starts reading (readers = {}, writers = {})", id, readers_, writers_));
+        WriterNode* next = *writers_queue_.begin();
+        remove_waiting_writer(*next);
+        writers_++;
+        update_reader_hint();
+        next->granted_at = std::chrono::steady_clock::now();
+#if LIBRARY_PROFILING
+        next->granted_ticks = LockProfiler::now();
+#endif
+        return next;
     }
 
-    void end_read(int id) {
-        std::unique_lock lock(mutex_);
-        readers_--;
+    void remove_waiting_writer(WriterNode& node) {
+        writers_queue_.erase(&node);
+        node.queued = false;
+        waiting_writers_--;
+        waiting_by_priority_[static_cast<int>(node.priority)]--;
+        update_reader_hint();
+    }
 
-        log(std::format("Reader {} finished reading (readers = {}, writers = {})", id, readers_, writers_));
+    static void wake_writer(WriterNode* node) {
+        if (node->state.exchange(NodeState::granted) == NodeState::parked) {
+            node->granted.release();
+        }
+    }
 
-        if (readers_ == 0) {
-            cond_writers_.notify_one();
+    std::chrono::nanoseconds spin_budget(std::int64_t expected_wait_ns) const {
+        switch (wait_mode_) {
+        case WaitMode::park:
+            return std::chrono::nanoseconds::zero();
+        case WaitMode::spin:
+            return max_spin_;
+        case WaitMode::adaptive:
+            if (expected_wait_ns > max_spin_.count()) {
+                return std::chrono::nanoseconds::zero();
+            }
+            return std::clamp(std::chrono::nanoseconds(4 * expected_wait_ns), min_spin_, max_spin_);
         }
+        return std::chrono::nanoseconds::zero();
     }
 
-    void start_write(int id) {
-        std::unique_lock lock(mutex_);
-        waiting_writers_++;
-        writers_queue_.push_back(id); 
-        log(std::format("Writer {} is waiting to write", id));
+    static std::chrono::nanoseconds bounded_budget(std::chrono::nanoseconds budget, std::optional<Deadline> deadline) {
+        if (!deadline) {
+            return budget;
+        }
+        return std::min(budget, std::chrono::duration_cast<std::chrono::nanoseconds>(*deadline - std::chrono::steady_clock::now()));
+    }
 
-        cond_writers_.wait(lock, [this, id] {
-            return readers_ == 0 && writers_ == 0 && !writers_queue_.empty() && writers_queue_.front() == id;
-        });
+    bool wait_for_grant(WriterNode& node, std::optional<Deadline> deadline) {
+        auto expected_wait = std::max(read_hold_ns_.load(std::memory_order_relaxed), write_hold_ns_.load(std::memory_order_relaxed));
+        bool settled = spin_until([&node] {
+            return node.state.load(std::memory_order_acquire) != NodeState::waiting;
+        }, bounded_budget(spin_budget(expected_wait), deadline));
 
-        waiting_writers_--;
-        writers_++;
-        log(std::format("Writer {} starts writing (writers = {}, readers = {})", id, writers_, readers_));
+        NodeState expected = NodeState::waiting;
+        if (settled || !node.state.compare_exchange_strong(expected, NodeState::parked)) {
+            return node.state.load(std::memory_order_acquire) == NodeState::granted;
+        }
+
+        if (!deadline) {
+            node.granted.acquire();
+        } else if (!node.granted.try_acquire_until(*deadline)) {
+            return abandon_write(node);
+        }
+        return node.state.load(std::memory_order_acquire) == NodeState::granted;
     }
 
-    void end_write(int id) {
-        std::unique_lock lock(mutex_);
-        writers_--;
+    bool withdraw_writer(WriterNode& node) {
+        WriterNode* next = nullptr;
+        {
+            std::scoped_lock lock(mutex_);
+            if (!node.queued) {
+                return false;
+            }
+
+            remove_waiting_writer(node);
+            next = grant_next_writer();
+            if (!next) {
+                wake_readers();
+            }
+        }
 
-        log(std::format("Writer {} finished writing (writers = {}, readers = {})", id, writers_, readers_));
+        if (next) {
+            wake_writer(next);
+        }
+        return true;
+    }
 
-        if (!writers_queue_.empty() && writers_queue_.front() == id) {
-            writers_queue_.pop_front();
+    bool abandon_write(WriterNode& node) {
+        if (withdraw_writer(node)) {
+            return false;
         }
-        
-        if (waiting_readers_ > 0 && writers_queue_.empty()) {
-            cond_readers_.notify_all();
-        } else if (!writers_queue_.empty()) {
-            cond_writers_.notify_all();
+
+        node.granted.acquire();
+        return node.state.load(std::memory_order_acquire) == NodeState::granted;
+    }
+
+    void cancel_write(WriterNode& node) {
+        if (withdraw_writer(node) && node.state.exchange(NodeState::cancelled) == NodeState::parked) {
+            node.granted.release();
         }
     }
 
-    void reading(int id) { 
-        log(std::format("Reader {} is reading", id));
-        std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    long long apply_pending_writes() {
+        long long applied = 0;
+        for (int pass = 0; pass < combining_passes_; ++pass) {
+            long long applied_in_pass = 0;
+            for (auto& slot : combining_slots_) {
+                CombineState pending = CombineState::pending;
+                if (slot.state.load(std::memory_order_acquire) == CombineState::pending &&
+                    slot.state.compare_exchange_strong(pending, CombineState::applying, std::memory_order_acquire)) {
+                    slot.apply(slot.operation);
+                    slot.state.store(CombineState::applied, std::memory_order_release);
+                    slot.state.notify_one();
+                    applied_in_pass++;
+                }
+            }
+            if (applied_in_pass == 0) {
+                break;
+            }
+            applied += applied_in_pass;
+        }
+        return applied;
     }
 
-    void writing(int id) { 
-        log(std::format("Writer {} is writing", id));
-        std::this_thread::sleep_for(std::chrono::milliseconds(600));
+    CombiningSlot& claim_combining_slot() {
+        thread_local std::size_t hint = std::hash<std::thread::id>{}(std::this_thread::get_id());
+        while (true) {
+            for (int i = 0; i < combining_slots_number_; ++i) {
+                std::size_t index = (hint + i) % combining_slots_number_;
+                CombiningSlot& slot = combining_slots_[index];
+                if (!slot.owned.load(std::memory_order_relaxed) && !slot.owned.exchange(true, std::memory_order_acquire)) {
+                    hint = index;
+                    return slot;
+                }
+            }
+            std::this_thread::yield();
+        }
     }
 
-    void log(const std::string& message) {
-        std::scoped_lock lock(io_mutex_);
-        std::cout << message << std::endl;
+    void release_combiner() {
+        combining_.store(false);
+        for (auto& slot : combining_slots_) {
+            if (slot.state.load() != CombineState::pending) {
+                continue;
+            }
+            bool expected = false;
+            if (!combining_.compare_exchange_strong(expected, true)) {
+                return;
+            }
+            CombineState pending = CombineState::pending;
+            if (slot.state.compare_exchange_strong(pending, CombineState::combine)) {
+                slot.state.notify_one();
+                return;
+            }
+            combining_.store(false);
+        }
     }
 
-    void summary() {
-        log("\n--- Simulation completed ---");
-        log("Final state:");
-        log(std::format("  Active readers: {}", readers_));
-        log(std::format("  Active writers: {}", writers_));
-        log(std::format("  Waiting writers: {}", waiting_writers_));
+    std::size_t waiting_threads() const {
+#if LIBRARY_PROFILING
+        return waiting_readers_ + waiting_writers_ + waiting_upgraders_;
+#else
+        return 0;
+#endif
+    }
 
-        if (readers_ == 0 && writers_ == 0) {
-            log("All threads have terminated.");
-        } else {
-            log("Some threads are still active.");
+    struct Occupancy {
+        int readers;
+        int writers;
+    };
+
+    Occupancy admit_reader(int id, std::uint64_t arrived = LockProfiler::now(), std::size_t queue_depth = 0) {
+        readers_++;
+        profiler_.record_wait(LockProfiler::Role::reader, id, arrived, queue_depth);
+
+        if (wait_mode_ == WaitMode::adaptive) {
+            read_acquired_at() = std::chrono::steady_clock::now();
         }
+        return {readers_, writers_};
     }
 
-    void simulate(int readers_number, int writers_number, int duration_time) {
-        std::vector<std::jthread> readers_threads;
-        std::vector<std::jthread> writers_threads;
+    Occupancy admit_writer(int id, std::uint64_t arrived = LockProfiler::now(), std::size_t queue_depth = 0) {
+        writers_++;
+        profiler_.record_wait(LockProfiler::Role::writer, id, arrived, queue_depth);
+        update_reader_hint();
+        write_acquired_at_ = std::chrono::steady_clock::now();
+        return {readers_, writers_};
+    }
 
-        for (int i = 0; i < readers_number; ++i) {
-            readers_threads.emplace_back(Reader(i, *this));
+    void log_reading(int id, Occupancy occupancy) {
+        log("Reader {} starts reading (readers = {}, writers = {})", id, occupancy.readers, occupancy.writers);
+    }
+
+    void log_writing(int id, Occupancy occupancy) {
+        log("Writer {} starts writing (writers = {}, readers = {})", id, occupancy.writers, occupancy.readers);
+    }
+
+    bool acquire_read(int id, std::optional<Deadline> deadline, std::stop_token stop) {
+        std::uint64_t arrived = LockProfiler::now();
+        if (readers_blocked_.load(std::memory_order_relaxed)) {
+            spin_until([this] {
+                return !readers_blocked_.load(std::memory_order_relaxed);
+            }, bounded_budget(spin_budget(write_hold_ns_.load(std::memory_order_relaxed)), deadline));
         }
-        
-        for (int i = 0; i < writers_number; ++i) {
-            writers_threads.emplace_back(Writer(i, *this));
+
+        std::unique_lock lock(mutex_);
+        std::size_t queue_depth = waiting_threads();
+        if (waiting_readers_++ == 0) {
+            readers_waiting_since_ = std::chrono::steady_clock::now();
         }
 
-        std::this_thread::sleep_for(std::chrono::seconds(duration_time));
+        auto can_read = [this] {
+            return this->can_read();
+        };
 
-        for (auto& t : readers_threads) {
-            t.request_stop();
+        bool admitted = can_read();
+        while (!admitted && !stop.stop_requested() && (!deadline || std::chrono::steady_clock::now() < *deadline)) {
+            std::optional<Deadline> recheck = read_recheck_at(deadline);
+            admitted = recheck ? cond_readers_.wait_until(lock, stop, *recheck, can_read) : cond_readers_.wait(lock, stop, can_read);
+        }
+        if (!admitted) {
+            waiting_readers_--;
+            WriterNode* next = nullptr;
+            if (waiting_readers_ == 0 && readers_turn_) {
+                readers_turn_ = false;
+                next = grant_next_writer();
+            }
+            lock.unlock();
+            if (next) {
+                wake_writer(next);
+            }
+            log("Reader {} gave up waiting to read", id);
+            return false;
         }
 
-        for (auto& t : writers_threads) {
-            t.request_stop();
+        if (--waiting_readers_ == 0) {
+            readers_turn_ = false;
+        }
+
+        if (waiting_readers_ > 0) {
+            cond_readers_.notify_one(); 
         }
+
+        Occupancy occupancy = admit_reader(id, arrived, queue_depth);
+        lock.unlock();
+        log_reading(id, occupancy);
+        return true;
     }
-};
 
-Reader::Reader(int id, Library& library) : id_(id), library_(library) {}
+    bool acquire_write(int id, std::optional<Deadline> deadline, WritePriority priority, std::stop_token stop) {
+        if (stop.stop_requested()) {
+            return false;
+        }
 
-void Reader::operator()(std::stop_token stop) {
-    std::mt19937 gen(std::random_device{}());
-    std::uniform_int_distribution<> dist(200, 500);
+        std::uint64_t arrived = LockProfiler::now();
+        std::size_t queue_depth = 0;
+        WriterNode node{id, priority, std::chrono::steady_clock::now() + write_budgets_[static_cast<int>(priority)], 0};
+        {
+            std::unique_lock lock(mutex_);
+            if (can_write() && writers_queue_.empty()) {
+                Occupancy occupancy = admit_writer(id, arrived);
+                lock.unlock();
+                log_writing(id, occupancy);
+                return true;
+            }
 
-    while (!stop.stop_requested()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(dist(gen)));
-        library_.start_read(id_);
-        library_.reading(id_);
-        library_.end_read(id_);
+            queue_depth = waiting_threads();
+
+            node.sequence = writers_sequence_++;
+            node.queued = true;
+            waiting_writers_++;
+            waiting_by_priority_[static_cast<int>(priority)]++;
+            writers_queue_.insert(&node);
+            update_reader_hint();
+        }
+        log("Writer {} is waiting to write", id);
+
+        std::stop_callback cancel(stop, [this, &node] {
+            cancel_write(node);
+        });
+        if (!wait_for_grant(node, deadline)) {
+            log("Writer {} gave up waiting to write", id);
+            return false;
+        }
+
+        write_acquired_at_ = std::chrono::steady_clock::now();
+        auto latency = write_acquired_at_ - node.granted_at;
+        handoffs_.fetch_add(1, std::memory_order_relaxed);
+        handoff_ns_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count(), std::memory_order_relaxed);
+        profiler_.record_wait(LockProfiler::Role::writer, id, arrived, queue_depth);
+#if LIBRARY_PROFILING
+        profiler_.record_handoff(LockProfiler::Role::writer, id, node.granted_ticks);
+#endif
+        log("Writer {} starts writing (handed over)", id);
+        return true;
     }
-}
 
-Writer::Writer(int id, Library& library) : id_(id), library_(library) {}
+    static void record_hold(std::atomic<std::int64_t>& average_ns, std::chrono::steady_clock::time_point acquired_at) {
+        std::int64_t hold = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - acquired_at).count();
+        std::int64_t average = average_ns.load(std::memory_order_relaxed);
+        average_ns.store(average + (hold - average) / 8, std::memory_order_relaxed);
+    }
 
-void Writer::operator()(std::stop_token stop) {
-    std::mt19937 gen(std::random_device{}());
-    std::uniform_int_distribution<> dist(2000, 3000);
+public:
+    struct HandoffStats {
+        long long handoffs;
+        double average_ns;
+    };
 
-    while (!stop.stop_requested()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(dist(gen)));
-        library_.start_write(id_);
-        library_.writing(id_);
-        library_.end_write(id_);
+    explicit Library(bool verbose = true, WaitMode wait_mode = WaitMode::adaptive)
+        : verbose_(verbose), wait_mode_(wait_mode) {}
+
+    void start_read(int id) {
+        acquire_read(id, std::nullopt, {});
     }
-}
 
-int main() {
+    bool start_read(int id, std::stop_token stop) {
+        return acquire_read(id, std::nullopt, stop);
+    }
+
+    bool try_start_read(int id) {
+        std::unique_lock lock(mutex_);
+        if (!can_read()) {
+            return false;
+        }
+
+        Occupancy occupancy = admit_reader(id);
+        lock.unlock();
+        log_reading(id, occupancy);
+        return true;
+    }
+
+    bool start_read_until(int id, Deadline deadline) {
+        return acquire_read(id, deadline, {});
+    }
+
+    void end_read(int id) {
+        WriterNode* next = nullptr;
+        Occupancy occupancy{};
+        {
+            std::unique_lock lock(mutex_);
+            readers_--;
+            profiler_.record_release(LockProfiler::Role::reader, id);
+
+            if (wait_mode_ == WaitMode::adaptive) {
+                record_hold(read_hold_ns_, read_acquired_at());
+            }
+
+            occupancy = {readers_, writers_};
+
+            if (readers_ == 0 && upgrading_) {
+                cond_upgrade_.notify_one();
+            }
+            next = grant_next_writer();
+        }
+
+        if (next) {
+            wake_writer(next);
+        }
+        log("Reader {} finished reading (readers = {}, writers = {})", id, occupancy.readers, occupancy.writers);
+    }
+
+    void start_write(int id, WritePriority priority = WritePriority::normal) {
+        acquire_write(id, std::nullopt, priority, {});
+    }
+
+    bool start_write(int id, std::stop_token stop, WritePriority priority = WritePriority::normal) {
+        return acquire_write(id, std::nullopt, priority, stop);
+    }
+
+    bool try_start_write(int id) {
+        std::unique_lock lock(mutex_);
+        if (!can_write() || !writers_queue_.empty()) {
+            return false;
+        }
+
+        Occupancy occupancy = admit_writer(id);
+        lock.unlock();
+        log_writing(id, occupancy);
+        return true;
+    }
+
+    bool start_write_until(int id, Deadline deadline, WritePriority priority = WritePriority::normal) {
+        return acquire_write(id, deadline, priority, {});
+    }
+
+    void start_upgradeable_read(int id) {
+        start_upgradeable_read(id, {});
+    }
+
+    bool start_upgradeable_read(int id, std::stop_token stop) {
+        std::unique_lock lock(mutex_);
+        waiting_upgraders_++;
+
+        bool admitted = cond_upgraders_.wait(lock, stop, [this] {
+            return can_read() && !upgrader_;
+        });
+
+        waiting_upgraders_--;
+        if (!admitted) {
+            lock.unlock();
+            log("Reader {} gave up waiting for upgradeable reading", id);
+            return false;
+        }
+        upgrader_ = true;
+        Occupancy occupancy{readers_, writers_};
+        lock.unlock();
+        log("Reader {} starts upgradeable reading (readers = {}, writers = {})", id, occupancy.readers, occupancy.writers);
+        return true;
+    }
+
+    void end_upgradeable_read(int id) {
+        WriterNode* next = nullptr;
+        Occupancy occupancy{};
+        {
+            std::unique_lock lock(mutex_);
+            upgrader_ = false;
+            occupancy = {readers_, writers_};
+
+            next = grant_next_writer();
+            if (!next && waiting_upgraders_ > 0) {
+                cond_upgraders_.notify_one();
+            }
+        }
+
+        if (next) {
+            wake_writer(next);
+        }
+        log("Reader {} finished upgradeable reading (readers = {}, writers = {})", id, occupancy.readers, occupancy.writers);
+    }
+
+    void upgrade(int id) {
+        upgrade(id, {});
+    }
+
+    // On a stop request the caller stays an upgradeable reader and readers held back by the
+    // pending upgrade are let in again.
+    bool upgrade(int id, std::stop_token stop) {
+        std::uint64_t arrived = LockProfiler::now();
+        std::unique_lock lock(mutex_);
+        upgrading_ = true;
+        update_reader_hint();
+        int readers = readers_;
+        lock.unlock();
+        log("Reader {} is waiting to upgrade (readers = {})", id, readers);
+        lock.lock();
+
+        bool drained = cond_upgrade_.wait(lock, stop, [this] {
+            return readers_ == 0;
+        });
+
+        upgrading_ = false;
+        if (!drained) {
+            update_reader_hint();
+            wake_readers();
+            lock.unlock();
+            log("Reader {} gave up waiting to upgrade", id);
+            return false;
+        }
+        upgrader_ = false;
+        Occupancy occupancy = admit_writer(id, arrived);
+        lock.unlock();
+        log_writing(id, occupancy);
+        return true;
+    }
+
+    void downgrade(int id) {
+        std::unique_lock lock(mutex_);
+        writers_--;
+        update_reader_hint();
+        profiler_.record_release(LockProfiler::Role::writer, id);
+
+        if (wait_mode_ == WaitMode::adaptive) {
+            record_hold(write_hold_ns_, write_acquired_at_);
+        }
+
+        Occupancy occupancy = admit_reader(id);
+        wake_readers();
+        lock.unlock();
+        log_reading(id, occupancy);
+    }
+
+    void end_write(int id) {
+        WriterNode* next = nullptr;
+        Occupancy occupancy{};
+        {
+            std::unique_lock lock(mutex_);
+            writers_--;
+            update_reader_hint();
+            profiler_.record_release(LockProfiler::Role::writer, id);
+
+            if (wait_mode_ == WaitMode::adaptive) {
+                record_hold(write_hold_ns_, write_acquired_at_);
+            }
+
+            occupancy = {readers_, writers_};
+
+            if (readers_overdue()) {
+                readers_turn_ = true;
+                update_reader_hint();
+            } else {
+                next = grant_next_writer();
+            }
+            if (!next) {
+                wake_readers();
+            }
+        }
+
+        if (next) {
+            wake_writer(next);
+        }
+        log("Writer {} finished writing (writers = {}, readers = {})", id, occupancy.writers, occupancy.readers);
+    }
+
+    template<typename F>
+    void combine_write(int id, F&& operation) {
+        combine_write(id, {}, std::forward<F>(operation));
+    }
+
+    // Returns false if a stop request withdrew the operation before any combiner applied it.
+    template<typename F>
+    bool combine_write(int id, std::stop_token stop, F&& operation) {
+        CombiningSlot& slot = claim_combining_slot();
+        slot.operation = &operation;
+        slot.apply = [](void* op) {
+            (*static_cast<std::remove_reference_t<F>*>(op))();
+        };
+        slot.state.store(CombineState::pending);
+
+        bool expected = false;
+        bool combiner = combining_.compare_exchange_strong(expected, true);
+        if (!combiner) {
+            std::stop_callback withdraw(stop, [&slot] {
+                CombineState pending = CombineState::pending;
+                if (slot.state.compare_exchange_strong(pending, CombineState::idle)) {
+                    slot.state.notify_one();
+                }
+            });
+            auto waiting = [](CombineState state) {
+                return state == CombineState::pending || state == CombineState::applying;
+            };
+            for (int spin = 0; spin < combining_spins_ && waiting(slot.state.load(std::memory_order_acquire)); ++spin) {
+                cpu_relax();
+            }
+            CombineState state;
+            while (waiting(state = slot.state.load(std::memory_order_acquire))) {
+                slot.state.wait(state, std::memory_order_acquire);
+            }
+            combiner = state == CombineState::combine;
+        }
+
+        if (combiner) {
+            if (start_write(id, stop)) {
+                long long applied = 0;
+                if (slot.state.load(std::memory_order_relaxed) == CombineState::combine) {
+                    slot.apply(slot.operation);
+                    slot.state.store(CombineState::applied, std::memory_order_relaxed);
+                    applied++;
+                }
+                applied += apply_pending_writes();
+                end_write(id);
+
+                combined_batches_.fetch_add(1, std::memory_order_relaxed);
+                combined_operations_.fetch_add(applied, std::memory_order_relaxed);
+            } else {
+                CombineState pending = CombineState::pending;
+                slot.state.compare_exchange_strong(pending, CombineState::idle);
+            }
+            release_combiner();
+        }
+
+        bool applied = slot.state.load(std::memory_order_relaxed) == CombineState::applied;
+        slot.state.store(CombineState::idle, std::memory_order_relaxed);
+        slot.owned.store(false, std::memory_order_release);
+        return applied;
+    }
+
+    double average_combined_batch() const {
+        long long batches = combined_batches_.load();
+        return batches ? static_cast<double>(combined_operations_.load()) / batches : 0.0;
+    }
+
+    HandoffStats handoff_stats() const {
+        long long handoffs = handoffs_.load();
+        return {handoffs, handoffs ? static_cast<double>(handoff_ns_.load()) / handoffs : 0.0};
+    }
+
+    void reading(int id, std::stop_token stop = {}) { 
+        log("Reader {} is reading", id);
+        interruptible_sleep(stop, LibraryScenario{}.read_time);
+    }
+
+    void writing(int id, std::stop_token stop = {}) { 
+        log("Writer {} is writing", id);
+        interruptible_sleep(stop, LibraryScenario{}.write_time);
+    }
+
+    template<typename... Args>
+    void log(std::format_string<Args...> fmt, Args&&... args) {
+        if (!verbose_) {
+            return;
+        }
+        AsyncLogger::global().log(fmt, std::forward<Args>(args)...);
+    }
+
+    void summary() {
+        log("\n--- Simulation completed ---");
+        log("Final state:");
+        log("  Active readers: {}", readers_);
+        log("  Active writers: {}", writers_);
+        log("  Waiting writers: {}", waiting_writers_);
+
+        if (readers_ == 0 && writers_ == 0) {
+            log("All threads have terminated.");
+        } else {
+            log("Some threads are still active.");
+        }
+
+        if (verbose_) {
+            AsyncLogger::global().flush();
+        }
+        profiler_.report();
+    }
+
+    std::chrono::microseconds simulate(int readers_number, int writers_number, int duration_time) {
+        std::vector<std::jthread> readers_threads;
+        std::vector<std::jthread> writers_threads;
+
+        for (int i = 0; i < readers_number; ++i) {
+            readers_threads.emplace_back(Reader(i, *this));
+        }
+        
+        for (int i = 0; i < writers_number; ++i) {
+            writers_threads.emplace_back(Writer(i, *this));
+        }
+
+        std::this_thread::sleep_for(std::chrono::seconds(duration_time));
+        auto stop_requested_at = std::chrono::steady_clock::now();
+
+        for (auto& t : readers_threads) {
+            t.request_stop();
+        }
+
+        for (auto& t : writers_threads) {
+            t.request_stop();
+        }
+
+        readers_threads.clear();
+        writers_threads.clear();
+
+        auto shutdown = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - stop_requested_at);
+        log("All threads stopped {} us after the stop request", shutdown.count());
+        return shutdown;
+    }
+};
+
+Reader::Reader(int id, Library& library) : id_(id), library_(library) {}
+
+void Reader::operator()(std::stop_token stop) {
+    std::mt19937 gen(std::random_device{}());
+    LibraryScenario scenario;
+    std::uniform_int_distribution<> dist(scenario.reader_pause_min.count(), scenario.reader_pause_max.count());
+
+    while (interruptible_sleep(stop, std::chrono::milliseconds(dist(gen))) && library_.start_read(id_, stop)) {
+        library_.reading(id_, stop);
+        library_.end_read(id_);
+    }
+}
+
+Writer::Writer(int id, Library& library) : id_(id), library_(library) {}
+
+void Writer::operator()(std::stop_token stop) {
+    std::mt19937 gen(std::random_device{}());
+    LibraryScenario scenario;
+    std::uniform_int_distribution<> dist(scenario.writer_pause_min.count(), scenario.writer_pause_max.count());
+
+    while (interruptible_sleep(stop, std::chrono::milliseconds(dist(gen))) && library_.start_write(id_, stop)) {
+        library_.writing(id_, stop);
+        library_.end_write(id_);
+    }
+}
+
+class RcuDomain {
+private:
+    static constexpr int max_threads_ = 256;
+    static constexpr std::size_t reclaim_threshold_ = 64;
+
+    struct alignas(64) ThreadSlot {
+        std::atomic<std::uint64_t> epoch{0};
+        std::atomic<bool> in_use{false};
+        int nesting = 0;
+    };
+
+    struct Retired {
+        std::uint64_t epoch;
+        void* pointer;
+        void (*deleter)(void*);
+    };
+
+    class SlotOwner {
+    private:
+        ThreadSlot* slot_ = nullptr;
+
+    public:
+        explicit SlotOwner(RcuDomain& domain) {
+            for (auto& slot : domain.slots_) {
+                bool expected = false;
+                if (slot.in_use.compare_exchange_strong(expected, true)) {
+                    slot_ = &slot;
+                    return;
+                }
+            }
+            throw std::runtime_error("RcuDomain: no free reader slot");
+        }
+
+        ~SlotOwner() {
+            slot_->epoch.store(0, std::memory_order_release);
+            slot_->in_use.store(false, std::memory_order_release);
+        }
+
+        ThreadSlot& slot() {
+            return *slot_;
+        }
+    };
+
+    alignas(64) std::atomic<std::uint64_t> global_epoch_{1};
+    std::array<ThreadSlot, max_threads_> slots_;
+    std::mutex retired_mutex_;
+    std::vector<Retired> retired_;
+
+    RcuDomain() = default;
+
+    ThreadSlot& local_slot() {
+        thread_local SlotOwner owner(*this);
+        return owner.slot();
+    }
+
+    std::uint64_t oldest_reader_epoch() const {
+        std::uint64_t oldest = UINT64_MAX;
+        for (const auto& slot : slots_) {
+            std::uint64_t epoch = slot.epoch.load();
+            if (epoch != 0) {
+                oldest = std::min(oldest, epoch);
+            }
+        }
+        return oldest;
+    }
+
+    void reclaim_locked() {
+        std::uint64_t oldest = oldest_reader_epoch();
+        auto expired = std::partition(retired_.begin(), retired_.end(), [oldest](const Retired& r) {
+            return r.epoch >= oldest;
+        });
+        for (auto it = expired; it != retired_.end(); ++it) {
+            it->deleter(it->pointer);
+        }
+        retired_.erase(expired, retired_.end());
+    }
+
+public:
+    RcuDomain(const RcuDomain&) = delete;
+    RcuDomain& operator=(const RcuDomain&) = delete;
+
+    ~RcuDomain() {
+        for (auto& r : retired_) {
+            r.deleter(r.pointer);
+        }
+    }
+
+    static RcuDomain& global() {
+        static RcuDomain domain;
+        return domain;
+    }
+
+    void read_lock() {
+        ThreadSlot& slot = local_slot();
+        if (slot.nesting++ == 0) {
+            slot.epoch.store(global_epoch_.load(std::memory_order_relaxed));
+        }
+    }
+
+    void read_unlock() {
+        ThreadSlot& slot = local_slot();
+        if (--slot.nesting == 0) {
+            slot.epoch.store(0, std::memory_order_release);
+        }
+    }
+
+    template<typename T>
+    void retire(T* pointer) {
+        std::uint64_t epoch = global_epoch_.fetch_add(1);
+        std::scoped_lock lock(retired_mutex_);
+        retired_.push_back({epoch, pointer, [](void* p) { delete static_cast<T*>(p); }});
+        if (retired_.size() >= reclaim_threshold_) {
+            reclaim_locked();
+        }
+    }
+
+    void synchronize() {
+        std::uint64_t epoch = global_epoch_.fetch_add(1);
+        while (oldest_reader_epoch() <= epoch) {
+            std::this_thread::yield();
+        }
+        std::scoped_lock lock(retired_mutex_);
+        reclaim_locked();
+    }
+
+};
+
+class RcuReadLock {
+private:
+    RcuDomain& domain_;
+
+public:
+    explicit RcuReadLock(RcuDomain& domain = RcuDomain::global()) : domain_(domain) {
+        domain_.read_lock();
+    }
+
+    ~RcuReadLock() {
+        domain_.read_unlock();
+    }
+
+    RcuReadLock(const RcuReadLock&) = delete;
+    RcuReadLock& operator=(const RcuReadLock&) = delete;
+};
+
+template<typename T>
+class RcuPointer {
+private:
+    RcuDomain& domain_;
+    std::atomic<T*> current_;
+    std::mutex writer_mutex_;
+
+public:
+    explicit RcuPointer(std::unique_ptr<T> initial, RcuDomain& domain = RcuDomain::global())
+        : domain_(domain), current_(initial.release()) {}
+
+    ~RcuPointer() {
+        delete current_.load();
+    }
+
+    RcuPointer(const RcuPointer&) = delete;
+    RcuPointer& operator=(const RcuPointer&) = delete;
+
+    const T* read() const {
+        return current_.load();
+    }
+
+    void publish(std::unique_ptr<T> next) {
+        T* old = current_.exchange(next.release());
+        domain_.retire(old);
+    }
+
+    template<typename F>
+    void update(F&& mutate) {
+        std::scoped_lock lock(writer_mutex_);
+        auto next = std::make_unique<T>(*current_.load(std::memory_order_relaxed));
+        mutate(*next);
+        publish(std::move(next));
+    }
+};
+
+template<typename T>
+class LeftRight {
+private:
+    static constexpr int reader_slots_ = 64;
+
+    struct alignas(64) ReaderSlot {
+        std::atomic<long> active{0};
+    };
+
+    using ReadIndicator = std::array<ReaderSlot, reader_slots_>;
+
+    std::array<T, 2> instances_;
+    std::array<ReadIndicator, 2> indicators_;
+    alignas(64) std::atomic<int> left_right_{0};
+    std::atomic<int> version_index_{0};
+    std::mutex writers_mutex_;
+
+    static std::atomic<long>& local_slot(ReadIndicator& indicator) {
+        static std::atomic<int> next_slot{0};
+        thread_local int slot = next_slot.fetch_add(1, std::memory_order_relaxed) % reader_slots_;
+        return indicator[slot].active;
+    }
+
+    static bool is_empty(const ReadIndicator& indicator) {
+        return std::all_of(indicator.begin(), indicator.end(), [](const ReaderSlot& slot) {
+            return slot.active.load() == 0;
+        });
+    }
+
+    static void wait_for_readers(const ReadIndicator& indicator) {
+        for (int spins = 0; !is_empty(indicator); ++spins) {
+            if (spins < 128) {
+                cpu_relax();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+public:
+    template<typename... Args>
+    explicit LeftRight(const Args&... args) : instances_{T(args...), T(args...)} {}
+
+    template<typename F>
+    decltype(auto) read(F&& f) {
+        int version = version_index_.load();
+        auto& active = local_slot(indicators_[version]);
+        active.fetch_add(1);
+
+        struct Departure {
+            std::atomic<long>& active;
+
+            ~Departure() {
+                active.fetch_sub(1, std::memory_order_release);
+            }
+        } departure{active};
+
+        return std::forward<F>(f)(std::as_const(instances_[left_right_.load()]));
+    }
+
+    template<typename Op>
+    void write(Op&& op) {
+        std::scoped_lock lock(writers_mutex_);
+
+        int reading = left_right_.load(std::memory_order_relaxed);
+        op(instances_[1 - reading]);
+        left_right_.store(1 - reading);
+
+        int previous = version_index_.load(std::memory_order_relaxed);
+        wait_for_readers(indicators_[1 - previous]);
+        version_index_.store(1 - previous);
+        wait_for_readers(indicators_[previous]);
+
+        op(instances_[reading]);
+    }
+};
+
+template<bool ProcessShared, bool RecoverOwner>
+class BasicFutexRwLock {
+private:
+    static constexpr std::uint32_t writer_ = 1u << 31;
+    static constexpr std::uint32_t writers_waiting_ = 1u << 30;
+    static constexpr std::uint32_t readers_waiting_ = 1u << 29;
+    static constexpr std::uint32_t readers_mask_ = readers_waiting_ - 1;
+    static constexpr std::uint32_t reader_bitset_ = 1;
+    static constexpr std::uint32_t writer_bitset_ = 2;
+    static constexpr int wait_op_ = ProcessShared ? FUTEX_WAIT_BITSET : FUTEX_WAIT_BITSET_PRIVATE;
+    static constexpr int wake_op_ = ProcessShared ? FUTEX_WAKE_BITSET : FUTEX_WAKE_BITSET_PRIVATE;
+    static constexpr long owner_check_ns_ = 50'000'000;
+
+    struct NoRecoveries {};
+
+    // While the writer bit is set the reader count is zero, so those bits carry the owner's pid.
+    // Liveness is judged by kill(pid, 0): a pid recycled within the check period keeps the lock wedged
+    // until the new process exits.
+    std::atomic<std::uint32_t> state_{0};
+    [[no_unique_address]] std::conditional_t<RecoverOwner, std::atomic<std::uint32_t>, NoRecoveries> recoveries_{};
+
+    static_assert(std::atomic<std::uint32_t>::is_always_lock_free && sizeof(state_) == sizeof(std::uint32_t));
+    static_assert(!RecoverOwner || ProcessShared);
+
+    static std::uint32_t owner_bits() {
+        if constexpr (RecoverOwner) {
+            return static_cast<std::uint32_t>(getpid()) & readers_mask_;
+        } else {
+            return 0;
+        }
+    }
+
+    void wait(std::uint32_t expected, std::uint32_t bitset) {
+        if constexpr (RecoverOwner) {
+            timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_nsec += owner_check_ns_;
+            if (deadline.tv_nsec >= 1'000'000'000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1'000'000'000;
+            }
+
+            if (syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&state_), wait_op_, expected, &deadline, nullptr, bitset) == -1 &&
+                errno == ETIMEDOUT) {
+                recover_dead_owner();
+            }
+        } else {
+            syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&state_), wait_op_, expected, nullptr, nullptr, bitset);
+        }
+    }
+
+    long wake(int count, std::uint32_t bitset) {
+        return syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&state_), wake_op_, count, nullptr, nullptr, bitset);
+    }
+
+    void wake_readers() {
+        state_.fetch_and(~readers_waiting_, std::memory_order_relaxed);
+        wake(INT_MAX, reader_bitset_);
+    }
+
+    void wake_next(std::uint32_t previous) {
+        if (previous & writers_waiting_) {
+            if (wake(1, writer_bitset_) > 0) {
+                return;
+            }
+        }
+        if (state_.load(std::memory_order_relaxed) & readers_waiting_) {
+            wake_readers();
+        }
+    }
+
+    void recover_dead_owner() {
+        std::uint32_t s = state_.load(std::memory_order_relaxed);
+        auto owner = static_cast<pid_t>(s & readers_mask_);
+        if ((s & writer_) == 0 || owner == 0 || kill(owner, 0) == 0 || errno != ESRCH) {
+            return;
+        }
+        if (!state_.compare_exchange_strong(s, s & ~(writer_ | writers_waiting_ | readers_mask_), std::memory_order_acquire)) {
+            return;
+        }
+
+        recoveries_.fetch_add(1, std::memory_order_relaxed);
+        wake_next(s);
+    }
+
+    void lock_contended(std::uint32_t s) {
+        std::uint32_t owner = owner_bits();
+        while (true) {
+            if ((s & (writer_ | readers_mask_)) == 0) {
+                if (state_.compare_exchange_weak(s, s | writer_ | writers_waiting_ | owner, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    return;
+                }
+                continue;
+            }
+
+            if ((s & writers_waiting_) == 0) {
+                if (!state_.compare_exchange_weak(s, s | writers_waiting_, std::memory_order_relaxed)) {
+                    continue;
+                }
+                s |= writers_waiting_;
+            }
+
+            wait(s, writer_bitset_);
+            s = state_.load(std::memory_order_relaxed);
+        }
+    }
+
+public:
+    void lock_shared() {
+        std::uint32_t s = state_.load(std::memory_order_relaxed);
+        while (true) {
+            if ((s & (writer_ | writers_waiting_)) == 0) {
+                if (state_.compare_exchange_weak(s, s + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    return;
+                }
+                continue;
+            }
+
+            if ((s & readers_waiting_) == 0) {
+                if (!state_.compare_exchange_weak(s, s | readers_waiting_, std::memory_order_relaxed)) {
+                    continue;
+                }
+                s |= readers_waiting_;
+            }
+
+            wait(s, reader_bitset_);
+            s = state_.load(std::memory_order_relaxed);
+        }
+    }
+
+    void unlock_shared() {
+        std::uint32_t s = state_.fetch_sub(1, std::memory_order_release) - 1;
+        if ((s & readers_mask_) == 0 && (s & writers_waiting_)) {
+            wake_next(s);
+        }
+    }
+
+    void lock() {
+        std::uint32_t expected = 0;
+        if (!state_.compare_exchange_strong(expected, writer_ | owner_bits(), std::memory_order_acquire, std::memory_order_relaxed)) {
+            lock_contended(expected);
+        }
+    }
+
+    void unlock() {
+        std::uint32_t expected = writer_ | owner_bits();
+        if (state_.compare_exchange_strong(expected, 0, std::memory_order_release, std::memory_order_relaxed)) {
+            return;
+        }
+        std::uint32_t previous = state_.fetch_and(~(writer_ | writers_waiting_ | readers_mask_), std::memory_order_release);
+        wake_next(previous);
+    }
+
+    std::uint32_t recoveries() const requires RecoverOwner {
+        return recoveries_.load(std::memory_order_relaxed);
+    }
+};
+
+using FutexRwLock = BasicFutexRwLock<false, false>;
+using SharedRwLock = BasicFutexRwLock<true, true>;
+
+static_assert(std::is_standard_layout_v<SharedRwLock>);
+
+class SharedMemory {
+private:
+    std::string name_;
+    std::size_t size_;
+    void* address_;
+
+public:
+    SharedMemory(std::string name, std::size_t size) : name_(std::move(name)), size_(size) {
+        int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd == -1) {
+            throw std::system_error(errno, std::generic_category(), "shm_open " + name_);
+        }
+
+        if (ftruncate(fd, static_cast<off_t>(size_)) == -1) {
+            int error = errno;
+            close(fd);
+            shm_unlink(name_.c_str());
+            throw std::system_error(error, std::generic_category(), "ftruncate " + name_);
+        }
+
+        address_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int error = errno;
+        close(fd);
+        if (address_ == MAP_FAILED) {
+            shm_unlink(name_.c_str());
+            throw std::system_error(error, std::generic_category(), "mmap " + name_);
+        }
+    }
+
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+
+    ~SharedMemory() {
+        munmap(address_, size_);
+        shm_unlink(name_.c_str());
+    }
+
+    template<typename T>
+    T* construct() {
+        if (sizeof(T) > size_) {
+            throw std::length_error("SharedMemory::construct: segment too small");
+        }
+        return new (address_) T{};
+    }
+};
+
+class AsyncLibrary {
+private:
+    boost::asio::thread_pool& executor_;
+    std::mutex mutex_;
+    int readers_ = 0;
+    bool writer_ = false;
+    std::vector<std::coroutine_handle<>> waiting_readers_;
+    std::deque<std::coroutine_handle<>> writers_queue_;
+
+    bool can_read() const {
+        return !writer_ && writers_queue_.empty();
+    }
+
+    bool can_write() const {
+        return !writer_ && readers_ == 0 && writers_queue_.empty();
+    }
+
+    bool suspend_reader(std::coroutine_handle<> handle) {
+        std::scoped_lock lock(mutex_);
+        if (can_read()) {
+            readers_++;
+            return false;
+        }
+        waiting_readers_.push_back(handle);
+        return true;
+    }
+
+    bool suspend_writer(std::coroutine_handle<> handle) {
+        std::scoped_lock lock(mutex_);
+        if (can_write()) {
+            writer_ = true;
+            return false;
+        }
+        writers_queue_.push_back(handle);
+        return true;
+    }
+
+    void resume(std::coroutine_handle<> handle) {
+        boost::asio::post(executor_, [handle] {
+            handle.resume();
+        });
+    }
+
+public:
+    class ReadAwaiter {
+    private:
+        AsyncLibrary& library_;
+
+    public:
+        explicit ReadAwaiter(AsyncLibrary& library) : library_(library) {}
+
+        bool await_ready() {
+            return library_.try_start_read();
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            return library_.suspend_reader(handle);
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    class WriteAwaiter {
+    private:
+        AsyncLibrary& library_;
+
+    public:
+        explicit WriteAwaiter(AsyncLibrary& library) : library_(library) {}
+
+        bool await_ready() {
+            return library_.try_start_write();
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            return library_.suspend_writer(handle);
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    explicit AsyncLibrary(boost::asio::thread_pool& executor) : executor_(executor) {}
+
+    ReadAwaiter read() {
+        return ReadAwaiter(*this);
+    }
+
+    WriteAwaiter write() {
+        return WriteAwaiter(*this);
+    }
+
+    bool try_start_read() {
+        std::scoped_lock lock(mutex_);
+        if (!can_read()) {
+            return false;
+        }
+        readers_++;
+        return true;
+    }
+
+    bool try_start_write() {
+        std::scoped_lock lock(mutex_);
+        if (!can_write()) {
+            return false;
+        }
+        writer_ = true;
+        return true;
+    }
+
+    void end_read() {
+        std::coroutine_handle<> next;
+        {
+            std::scoped_lock lock(mutex_);
+            readers_--;
+            if (readers_ == 0 && !writers_queue_.empty()) {
+                next = writers_queue_.front();
+                writers_queue_.pop_front();
+                writer_ = true;
+            }
+        }
+
+        if (next) {
+            resume(next);
+        }
+    }
+
+    void end_write() {
+        std::coroutine_handle<> next;
+        std::vector<std::coroutine_handle<>> readers;
+        {
+            std::scoped_lock lock(mutex_);
+            writer_ = false;
+            if (!writers_queue_.empty()) {
+                next = writers_queue_.front();
+                writers_queue_.pop_front();
+                writer_ = true;
+            } else {
+                readers_ += static_cast<int>(waiting_readers_.size());
+                readers.swap(waiting_readers_);
+            }
+        }
+
+        if (next) {
+            resume(next);
+        }
+        for (auto handle : readers) {
+            resume(handle);
+        }
+    }
+};
+
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() {
+            return {};
+        }
+
+        std::suspend_never initial_suspend() noexcept {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {}
+
+        void unhandled_exception() {
+            std::terminate();
+        }
+    };
+};
+
+class Reschedule {
+private:
+    boost::asio::thread_pool& executor_;
+
+public:
+    explicit Reschedule(boost::asio::thread_pool& executor) : executor_(executor) {}
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        boost::asio::post(executor_, [handle] {
+            handle.resume();
+        });
+    }
+
+    void await_resume() const noexcept {}
+};
+
+template<typename T>
+class VersionedTable {
+private:
+    using Chunk = std::vector<T>;
+
+    struct Version {
+        std::uint64_t number;
+        std::vector<std::shared_ptr<const Chunk>> chunks;
+    };
+
+    std::size_t size_;
+    std::size_t chunk_size_;
+    std::shared_ptr<std::atomic<long long>> live_versions_ = std::make_shared<std::atomic<long long>>(0);
+    std::atomic<std::shared_ptr<const Version>> current_;
+    std::mutex writer_mutex_;
+
+    std::shared_ptr<const Version> make_version(std::uint64_t number, std::vector<std::shared_ptr<const Chunk>> chunks) {
+        live_versions_->fetch_add(1);
+        return std::shared_ptr<const Version>(new Version{number, std::move(chunks)}, [counter = live_versions_](const Version* version) {
+            counter->fetch_sub(1);
+            delete version;
+        });
+    }
+
+public:
+    class Snapshot {
+    private:
+        std::shared_ptr<const Version> version_;
+        std::size_t chunk_size_;
+
+    public:
+        Snapshot(std::shared_ptr<const Version> version, std::size_t chunk_size)
+            : version_(std::move(version)), chunk_size_(chunk_size) {}
+
+        const T& operator[](std::size_t index) const {
+            return (*version_->chunks[index / chunk_size_])[index % chunk_size_];
+        }
+
+        std::uint64_t version() const {
+            return version_->number;
+        }
+    };
+
+    class Transaction {
+    private:
+        std::vector<std::shared_ptr<const Chunk>>& chunks_;
+        std::vector<Chunk*> copied_;
+        std::size_t chunk_size_;
+
+    public:
+        Transaction(std::vector<std::shared_ptr<const Chunk>>& chunks, std::size_t chunk_size)
+            : chunks_(chunks), copied_(chunks.size(), nullptr), chunk_size_(chunk_size) {}
+
+        const T& operator[](std::size_t index) const {
+            return (*chunks_[index / chunk_size_])[index % chunk_size_];
+        }
+
+        void set(std::size_t index, const T& value) {
+            std::size_t chunk = index / chunk_size_;
+            if (!copied_[chunk]) {
+                auto copy = std::make_shared<Chunk>(*chunks_[chunk]);
+                copied_[chunk] = copy.get();
+                chunks_[chunk] = std::move(copy);
+            }
+            (*copied_[chunk])[index % chunk_size_] = value;
+        }
+    };
+
+    explicit VersionedTable(std::size_t size, std::size_t chunk_size = 256, const T& value = T{})
+        : size_(size), chunk_size_(chunk_size) {
+        std::vector<std::shared_ptr<const Chunk>> chunks;
+        for (std::size_t begin = 0; begin < size_; begin += chunk_size_) {
+            chunks.push_back(std::make_shared<const Chunk>(chunk_size_, value));
+        }
+        current_.store(make_version(0, std::move(chunks)));
+    }
+
+    Snapshot snapshot() const {
+        return Snapshot(current_.load(std::memory_order_acquire), chunk_size_);
+    }
+
+    template<typename F>
+    std::uint64_t update(F&& mutate) {
+        std::scoped_lock lock(writer_mutex_);
+        auto base = current_.load(std::memory_order_relaxed);
+        std::vector<std::shared_ptr<const Chunk>> chunks = base->chunks;
+
+        Transaction transaction(chunks, chunk_size_);
+        mutate(transaction);
+
+        current_.store(make_version(base->number + 1, std::move(chunks)), std::memory_order_release);
+        return base->number + 1;
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    long long live_versions() const {
+        return live_versions_->load();
+    }
+};
+
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class ShardedHashMap {
+private:
+    static constexpr std::uint8_t empty_ = 0;
+    static constexpr std::uint8_t deleted_ = 1;
+    static constexpr std::size_t slots_ = std::max<std::size_t>(1, 64 / (sizeof(Key) + sizeof(Value) + 1));
+    static constexpr double max_load_ = 0.75;
+
+    struct alignas(64) Bucket {
+        std::array<std::uint8_t, slots_> tags{};
+        std::array<Key, slots_> keys{};
+        std::array<Value, slots_> values{};
+    };
+
+    struct alignas(64) Shard {
+        mutable FutexRwLock lock;
+        std::vector<Bucket> buckets;
+        std::size_t size = 0;
+        std::size_t used = 0;
+    };
+
+    std::vector<Shard> shards_;
+    int shard_bits_;
+    Hash hash_;
+
+    std::uint64_t hash_of(const Key& key) const {
+        return static_cast<std::uint64_t>(hash_(key)) * 0x9E3779B97F4A7C15ull;
+    }
+
+    std::size_t shard_of(std::uint64_t h) const {
+        return shard_bits_ == 0 ? 0 : static_cast<std::size_t>(h >> (64 - shard_bits_));
+    }
+
+    std::uint8_t tag_of(std::uint64_t h) const {
+        return static_cast<std::uint8_t>(0x80 | ((h << shard_bits_) >> 57));
+    }
+
+    std::size_t first_bucket(const Shard& shard, std::uint64_t h) const {
+        int bucket_bits = std::countr_zero(shard.buckets.size());
+        return bucket_bits == 0 ? 0 : static_cast<std::size_t>((h << (shard_bits_ + 7)) >> (64 - bucket_bits));
+    }
+
+    std::optional<std::pair<std::size_t, std::size_t>> locate(const Shard& shard, const Key& key, std::uint64_t h) const {
+        std::size_t mask = shard.buckets.size() - 1;
+        std::uint8_t tag = tag_of(h);
+
+        for (std::size_t i = first_bucket(shard, h), probes = 0; probes < shard.buckets.size(); i = (i + 1) & mask, ++probes) {
+            const Bucket& bucket = shard.buckets[i];
+            for (std::size_t slot = 0; slot < slots_; ++slot) {
+                if (bucket.tags[slot] == empty_) {
+                    return std::nullopt;
+                }
+                if (bucket.tags[slot] == tag && bucket.keys[slot] == key) {
+                    return std::pair{i, slot};
+                }
+            }
+        }
+        return std::nullopt;
+    }
+
+    const Value* find_in(const Shard& shard, const Key& key, std::uint64_t h) const {
+        auto position = locate(shard, key, h);
+        return position ? &shard.buckets[position->first].values[position->second] : nullptr;
+    }
+
+    void place(Shard& shard, const Key& key, const Value& value, std::uint64_t h) const {
+        std::size_t mask = shard.buckets.size() - 1;
+
+        for (std::size_t i = first_bucket(shard, h);; i = (i + 1) & mask) {
+            Bucket& bucket = shard.buckets[i];
+            for (std::size_t slot = 0; slot < slots_; ++slot) {
+                if (bucket.tags[slot] == empty_ || bucket.tags[slot] == deleted_) {
+                    shard.used += bucket.tags[slot] == empty_;
+                    shard.size++;
+                    bucket.tags[slot] = tag_of(h);
+                    bucket.keys[slot] = key;
+                    bucket.values[slot] = value;
+                    return;
+                }
+            }
+        }
+    }
+
+    void rehash(Shard& shard) {
+        std::size_t capacity = shard.buckets.size() * slots_;
+        std::size_t buckets = shard.buckets.size();
+        if (shard.size + 1 > max_load_ / 2 * capacity) {
+            buckets *= 2;
+        }
+
+        std::vector<Bucket> old(buckets);
+        old.swap(shard.buckets);
+        shard.size = 0;
+        shard.used = 0;
+
+        for (const Bucket& bucket : old) {
+            for (std::size_t slot = 0; slot < slots_; ++slot) {
+                if (bucket.tags[slot] != empty_ && bucket.tags[slot] != deleted_) {
+                    place(shard, bucket.keys[slot], bucket.values[slot], hash_of(bucket.keys[slot]));
+                }
+            }
+        }
+    }
+
+    bool insert_in(Shard& shard, const Key& key, const Value& value, std::uint64_t h) {
+        if (auto position = locate(shard, key, h)) {
+            shard.buckets[position->first].values[position->second] = value;
+            return false;
+        }
+        if (shard.used + 1 > max_load_ * shard.buckets.size() * slots_) {
+            rehash(shard);
+        }
+        place(shard, key, value, h);
+        return true;
+    }
+
+    template<typename KeyOf>
+    std::vector<std::pair<std::size_t, std::size_t>> group_by_shard(std::size_t count, KeyOf key_of, std::vector<std::uint64_t>& hashes) const {
+        std::vector<std::pair<std::size_t, std::size_t>> order(count);
+        hashes.resize(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            hashes[i] = hash_of(key_of(i));
+            order[i] = {shard_of(hashes[i]), i};
+        }
+        std::sort(order.begin(), order.end());
+        return order;
+    }
+
+public:
+    explicit ShardedHashMap(std::size_t shards = 64, std::size_t buckets_per_shard = 16)
+        : shards_(std::bit_ceil(std::max<std::size_t>(1, shards))),
+          shard_bits_(std::countr_zero(shards_.size())) {
+        for (auto& shard : shards_) {
+            shard.buckets.resize(std::bit_ceil(std::max<std::size_t>(1, buckets_per_shard)));
+        }
+    }
+
+    std::optional<Value> find(const Key& key) const {
+        std::uint64_t h = hash_of(key);
+        const Shard& shard = shards_[shard_of(h)];
+        std::shared_lock lock(shard.lock);
+        const Value* value = find_in(shard, key, h);
+        return value ? std::optional<Value>(*value) : std::nullopt;
+    }
+
+    bool insert_or_assign(const Key& key, const Value& value) {
+        std::uint64_t h = hash_of(key);
+        Shard& shard = shards_[shard_of(h)];
+        std::unique_lock lock(shard.lock);
+        return insert_in(shard, key, value, h);
+    }
+
+    bool erase(const Key& key) {
+        std::uint64_t h = hash_of(key);
+        Shard& shard = shards_[shard_of(h)];
+        std::unique_lock lock(shard.lock);
+        auto position = locate(shard, key, h);
+        if (!position) {
+            return false;
+        }
+
+        shard.buckets[position->first].tags[position->second] = deleted_;
+        shard.size--;
+        return true;
+    }
+
+    void find_batch(std::span<const Key> keys, std::span<std::optional<Value>> out) const {
+        std::vector<std::uint64_t> hashes;
+        auto order = group_by_shard(keys.size(), [&](std::size_t i) -> const Key& { return keys[i]; }, hashes);
+
+        for (std::size_t begin = 0; begin < order.size();) {
+            const Shard& shard = shards_[order[begin].first];
+            std::shared_lock lock(shard.lock);
+
+            std::size_t end = begin;
+            for (; end < order.size() && order[end].first == order[begin].first; ++end) {
+                std::size_t i = order[end].second;
+                const Value* value = find_in(shard, keys[i], hashes[i]);
+                out[i] = value ? std::optional<Value>(*value) : std::nullopt;
+            }
+            begin = end;
+        }
+    }
+
+    void insert_batch(std::span<const std::pair<Key, Value>> entries) {
+        std::vector<std::uint64_t> hashes;
+        auto order = group_by_shard(entries.size(), [&](std::size_t i) -> const Key& { return entries[i].first; }, hashes);
+
+        for (std::size_t begin = 0; begin < order.size();) {
+            Shard& shard = shards_[order[begin].first];
+            std::unique_lock lock(shard.lock);
+
+            std::size_t end = begin;
+            for (; end < order.size() && order[end].first == order[begin].first; ++end) {
+                std::size_t i = order[end].second;
+                insert_in(shard, entries[i].first, entries[i].second, hashes[i]);
+            }
+            begin = end;
+        }
+    }
+
+    std::size_t size() const {
+        std::size_t total = 0;
+        for (const auto& shard : shards_) {
+            std::shared_lock lock(shard.lock);
+            total += shard.size;
+        }
+        return total;
+    }
+};
+
+class VirtualLibrary {
+public:
+    struct RoleStats {
+        long long acquisitions = 0;
+        EventLoop::Duration total_wait{0};
+        EventLoop::Duration max_wait{0};
+
+        void record(EventLoop::Duration wait) {
+            acquisitions++;
+            total_wait += wait;
+            max_wait = std::max(max_wait, wait);
+        }
+
+        double average_wait_ms() const {
+            return acquisitions ? std::chrono::duration<double, std::milli>(total_wait).count() / acquisitions : 0.0;
+        }
+    };
+
+private:
+    EventLoop& loop_;
+    int readers_ = 0;
+    int writers_ = 0;
+    std::deque<std::coroutine_handle<>> waiting_readers_;
+    std::deque<std::coroutine_handle<>> writers_queue_;
+    RoleStats reads_;
+    RoleStats writes_;
+
+    bool can_read() const {
+        return writers_ == 0 && writers_queue_.empty();
+    }
+
+    bool can_write() const {
+        return readers_ == 0 && writers_ == 0;
+    }
+
+    void grant_next() {
+        if (can_write() && !writers_queue_.empty()) {
+            writers_++;
+            loop_.schedule(loop_.now(), writers_queue_.front());
+            writers_queue_.pop_front();
+            return;
+        }
+
+        if (can_read()) {
+            for (auto reader : waiting_readers_) {
+                readers_++;
+                loop_.schedule(loop_.now(), reader);
+            }
+            waiting_readers_.clear();
+        }
+    }
+
+    template<bool Write>
+    class Acquire {
+    private:
+        VirtualLibrary& library_;
+        EventLoop::Duration arrived_;
+
+    public:
+        explicit Acquire(VirtualLibrary& library) : library_(library), arrived_(library.loop_.now()) {}
+
+        bool await_ready() {
+            if constexpr (Write) {
+                if (library_.can_write() && library_.writers_queue_.empty()) {
+                    library_.writers_++;
+                    return true;
+                }
+            } else if (library_.can_read()) {
+                library_.readers_++;
+                return true;
+            }
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            (Write ? library_.writers_queue_ : library_.waiting_readers_).push_back(handle);
+        }
+
+        void await_resume() {
+            (Write ? library_.writes_ : library_.reads_).record(library_.loop_.now() - arrived_);
+        }
+    };
+
+public:
+    explicit VirtualLibrary(EventLoop& loop) : loop_(loop) {}
+
+    Acquire<false> start_read() {
+        return Acquire<false>(*this);
+    }
+
+    Acquire<true> start_write() {
+        return Acquire<true>(*this);
+    }
+
+    void end_read() {
+        readers_--;
+        grant_next();
+    }
+
+    void end_write() {
+        writers_--;
+        grant_next();
+    }
+
+    const RoleStats& reads() const {
+        return reads_;
+    }
+
+    const RoleStats& writes() const {
+        return writes_;
+    }
+};
+
+EventLoop::Task virtual_reader(EventLoop& loop, VirtualLibrary& library, LibraryScenario scenario, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<> dist(scenario.reader_pause_min.count(), scenario.reader_pause_max.count());
+
+    while (true) {
+        co_await loop.sleep_for(std::chrono::milliseconds(dist(gen)));
+        co_await library.start_read();
+        co_await loop.sleep_for(scenario.read_time);
+        library.end_read();
+    }
+}
+
+EventLoop::Task virtual_writer(EventLoop& loop, VirtualLibrary& library, LibraryScenario scenario, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<> dist(scenario.writer_pause_min.count(), scenario.writer_pause_max.count());
+
+    while (true) {
+        co_await loop.sleep_for(std::chrono::milliseconds(dist(gen)));
+        co_await library.start_write();
+        co_await loop.sleep_for(scenario.write_time);
+        library.end_write();
+    }
+}
+
+struct BenchmarkResult {
+    long long reads = 0;
+    long long writes = 0;
+    long long checksum = 0;
+    double seconds = 0.0;
+    std::vector<long long> thread_operations;
+};
+
+void busy_wait(std::chrono::nanoseconds duration) {
+    if (duration <= std::chrono::nanoseconds::zero()) {
+        return;
+    }
+    auto end = std::chrono::steady_clock::now() + duration;
+    while (std::chrono::steady_clock::now() < end) {
+        cpu_relax();
+    }
+}
+
+class LockBenchmark {
+public:
+    template<typename ReadOp, typename WriteOp>
+    static BenchmarkResult run(int threads_number, double read_ratio, int duration_ms, ReadOp read_op, WriteOp write_op) {
+        std::vector<BenchmarkResult> results(threads_number);
+
+        auto start = std::chrono::steady_clock::now();
+        {
+            std::vector<std::jthread> threads;
+            for (int i = 0; i < threads_number; ++i) {
+                threads.emplace_back([&, i](std::stop_token stop) {
+                    std::mt19937 gen(i + 1);
+                    std::bernoulli_distribution is_read(read_ratio);
+                    BenchmarkResult local;
+
+                    while (!stop.stop_requested()) {
+                        if (is_read(gen)) {
+                            local.checksum += read_op(i, gen);
+                            local.reads++;
+                        } else {
+                            write_op(i, gen);
+                            local.writes++;
+                        }
+                    }
+                    results[i] = local;
+                });
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(duration_ms));
+            for (auto& thread : threads) {
+                thread.request_stop();
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        BenchmarkResult total;
+        for (const auto& r : results) {
+            total.reads += r.reads;
+            total.writes += r.writes;
+            total.checksum += r.checksum;
+            total.thread_operations.push_back(r.reads + r.writes);
+        }
+        total.seconds = std::chrono::duration<double>(end - start).count();
+        return total;
+    }
+
+    static double fairness(const BenchmarkResult& r) {
+        double sum = 0.0;
+        double sum_squares = 0.0;
+        for (long long ops : r.thread_operations) {
+            sum += ops;
+            sum_squares += static_cast<double>(ops) * ops;
+        }
+        return sum_squares > 0.0 ? sum * sum / (r.thread_operations.size() * sum_squares) : 1.0;
+    }
+
+    static void print(const std::string& name, int read_percent, int threads_number, const BenchmarkResult& r) {
+        std::cout << std::format("{} | read:write {}:{} | threads: {} | {:.0f} reads/s | {:.0f} writes/s\n",
+                                 name, read_percent, 100 - read_percent, threads_number,
+                                 r.reads / r.seconds, r.writes / r.seconds);
+    }
+};
+
+template<typename Lock>
+void read_lock(Lock& lock, int) {
+    lock.lock_shared();
+}
+
+template<typename Lock>
+void read_unlock(Lock& lock, int) {
+    lock.unlock_shared();
+}
+
+template<typename Lock>
+void write_lock(Lock& lock, int) {
+    lock.lock();
+}
+
+template<typename Lock>
+void write_unlock(Lock& lock, int) {
+    lock.unlock();
+}
+
+void read_lock(Library& library, int id) {
+    library.start_read(id);
+}
+
+void read_unlock(Library& library, int id) {
+    library.end_read(id);
+}
+
+void write_lock(Library& library, int id) {
+    library.start_write(id);
+}
+
+void write_unlock(Library& library, int id) {
+    library.end_write(id);
+}
+
+void benchmark_rcu(int threads_number, int duration_ms) {
+    constexpr int table_size = 1024;
+    using RoutingTable = std::vector<int>;
+
+    for (int read_percent : {99, 90}) {
+        double read_ratio = read_percent / 100.0;
+
+        {
+            Library library(false);
+            RoutingTable table(table_size, 0);
+
+            auto result = LockBenchmark::run(threads_number, read_ratio, duration_ms,
+                [&](int id, std::mt19937& gen) {
+                    int key = gen() % table_size;
+                    library.start_read(id);
+                    int hop = table[key];
+                    library.end_read(id);
+                    return hop;
+                },
+                [&](int id, std::mt19937& gen) {
+                    int key = gen() % table_size;
+                    library.start_write(id);
+                    table[key] = id;
+                    library.end_write(id);
+                });
+            LockBenchmark::print("Library (mutex/condvar)", read_percent, threads_number, result);
+        }
+
+        {
+            RcuPointer<RoutingTable> table(std::make_unique<RoutingTable>(table_size, 0));
+
+            auto result = LockBenchmark::run(threads_number, read_ratio, duration_ms,
+                [&](int, std::mt19937& gen) {
+                    int key = gen() % table_size;
+                    RcuReadLock guard;
+                    return (*table.read())[key];
+                },
+                [&](int id, std::mt19937& gen) {
+                    int key = gen() % table_size;
+                    table.update([&](RoutingTable& t) {
+                        t[key] = id;
+                    });
+                });
+            RcuDomain::global().synchronize();
+            LockBenchmark::print("RCU (epoch reclamation)", read_percent, threads_number, result);
+        }
+    }
+}
+
+long context_switches() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+void benchmark_writer_handoff(int duration_ms) {
+    for (int writers_number : {1, 2, 4, 8, 16, 32}) {
+        Library library(false);
+        long long counter = 0;
+
+        long switches_before = context_switches();
+        auto result = LockBenchmark::run(writers_number, 0.0, duration_ms,
+            [](int, std::mt19937&) {
+                return 0;
+            },
+            [&](int id, std::mt19937&) {
+                library.start_write(id);
+                counter++;
+                library.end_write(id);
+            });
+        long switches = context_switches() - switches_before;
+
+        auto handoff = library.handoff_stats();
+        std::cout << std::format("Writers: {:>2} | {:.0f} acquisitions/s | handoffs: {} | handoff latency: {:.2f} us | context switches per acquisition: {:.3f}\n",
+                                 writers_number, result.writes / result.seconds, handoff.handoffs,
+                                 handoff.average_ns / 1000.0, static_cast<double>(switches) / std::max(1LL, result.writes));
+    }
+}
+
+void benchmark_wait_modes(int threads_number, int duration_ms) {
+    constexpr double read_ratio = 0.9;
+    const std::pair<WaitMode, const char*> modes[] = {
+        {WaitMode::park, "park"},
+        {WaitMode::spin, "spin"},
+        {WaitMode::adaptive, "adaptive"},
+    };
+
+    for (std::chrono::nanoseconds hold : {std::chrono::nanoseconds(50), std::chrono::nanoseconds(500),
+                                          std::chrono::nanoseconds(5000), std::chrono::nanoseconds(50000),
+                                          std::chrono::nanoseconds(1000000)}) {
+        for (const auto& [mode, mode_name] : modes) {
+            Library library(false, mode);
+
+            auto result = LockBenchmark::run(threads_number, read_ratio, duration_ms,
+                [&](int id, std::mt19937&) {
+                    library.start_read(id);
+                    busy_wait(hold);
+                    library.end_read(id);
+                    return 0;
+                },
+                [&](int id, std::mt19937&) {
+                    library.start_write(id);
+                    busy_wait(hold);
+                    library.end_write(id);
+                });
+
+            std::cout << std::format("Hold: {:>7} ns | mode: {:<8} | {:.0f} reads/s | {:.0f} writes/s\n",
+                                     hold.count(), mode_name, result.reads / result.seconds, result.writes / result.seconds);
+        }
+    }
+}
+
+struct BenchmarkConfig {
+    std::vector<std::string> locks{"library"};
+    std::vector<int> threads{4};
+    double read_ratio = 0.9;
+    std::chrono::nanoseconds critical_section{100};
+    std::chrono::nanoseconds think_time{0};
+    int duration_ms = 2000;
+    std::string format = "json";
+};
+
+struct BenchmarkReport {
+    std::string lock;
+    int threads_number = 0;
+    BenchmarkResult result;
+    LatencyHistogram read_latency;
+    LatencyHistogram write_latency;
+};
+
+template<typename Lock>
+BenchmarkReport measure_lock(const std::string& name, Lock& lock, const BenchmarkConfig& config, int threads_number) {
+    std::vector<LatencyHistogram> read_latency(threads_number);
+    std::vector<LatencyHistogram> write_latency(threads_number);
+    std::vector<int> data(threads_number, 0);
+
+    auto elapsed_ns = [](auto start) {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    };
+
+    BenchmarkReport report;
+    report.lock = name;
+    report.threads_number = threads_number;
+    report.result = LockBenchmark::run(threads_number, config.read_ratio, config.duration_ms,
+        [&](int id, std::mt19937&) {
+            auto start = std::chrono::steady_clock::now();
+            read_lock(lock, id);
+            read_latency[id].record(elapsed_ns(start));
+            busy_wait(config.critical_section);
+            int value = data[id];
+            read_unlock(lock, id);
+            busy_wait(config.think_time);
+            return value;
+        },
+        [&](int id, std::mt19937&) {
+            auto start = std::chrono::steady_clock::now();
+            write_lock(lock, id);
+            write_latency[id].record(elapsed_ns(start));
+            busy_wait(config.critical_section);
+            data[id]++;
+            write_unlock(lock, id);
+            busy_wait(config.think_time);
+        });
+
+    for (int i = 0; i < threads_number; ++i) {
+        report.read_latency.merge(read_latency[i]);
+        report.write_latency.merge(write_latency[i]);
+    }
+    return report;
+}
+
+void print_report(const BenchmarkReport& report, const BenchmarkConfig& config, bool header) {
+    const auto& r = report.result;
+    long long min_ops = 0;
+    long long max_ops = 0;
+    if (!r.thread_operations.empty()) {
+        auto [min_it, max_it] = std::minmax_element(r.thread_operations.begin(), r.thread_operations.end());
+        min_ops = *min_it;
+        max_ops = *max_it;
+    }
+
+    if (config.format == "csv") {
+        if (header) {
+            std::cout << "lock,threads,read_ratio,cs_ns,think_ns,seconds,reads_per_s,writes_per_s,"
+                         "read_p50_ns,read_p99_ns,read_p999_ns,write_p50_ns,write_p99_ns,write_p999_ns,"
+                         "fairness,min_thread_ops,max_thread_ops\n";
+        }
+        std::cout << std::format("{},{},{},{},{},{:.3f},{:.0f},{:.0f},{},{},{},{},{},{},{:.4f},{},{}\n",
+                                 report.lock, report.threads_number, config.read_ratio,
+                                 config.critical_section.count(), config.think_time.count(), r.seconds,
+                                 r.reads / r.seconds, r.writes / r.seconds,
+                                 report.read_latency.percentile(50.0), report.read_latency.percentile(99.0),
+                                 report.read_latency.percentile(99.9), report.write_latency.percentile(50.0),
+                                 report.write_latency.percentile(99.0), report.write_latency.percentile(99.9),
+                                 LockBenchmark::fairness(r), min_ops, max_ops);
+        return;
+    }
+
+    std::cout << std::format("{{\"lock\": \"{}\", \"threads\": {}, \"read_ratio\": {}, \"cs_ns\": {}, \"think_ns\": {}, "
+                             "\"seconds\": {:.3f}, \"reads_per_s\": {:.0f}, \"writes_per_s\": {:.0f}, "
+                             "\"read_latency_ns\": {{\"p50\": {}, \"p99\": {}, \"p999\": {}}}, "
+                             "\"write_latency_ns\": {{\"p50\": {}, \"p99\": {}, \"p999\": {}}}, "
+                             "\"fairness\": {:.4f}, \"min_thread_ops\": {}, \"max_thread_ops\": {}}}\n",
+                             report.lock, report.threads_number, config.read_ratio,
+                             config.critical_section.count(), config.think_time.count(), r.seconds,
+                             r.reads / r.seconds, r.writes / r.seconds,
+                             report.read_latency.percentile(50.0), report.read_latency.percentile(99.0),
+                             report.read_latency.percentile(99.9), report.write_latency.percentile(50.0),
+                             report.write_latency.percentile(99.0), report.write_latency.percentile(99.9),
+                             LockBenchmark::fairness(r), min_ops, max_ops);
+}
+
+BenchmarkReport measure_named_lock(const std::string& name, const BenchmarkConfig& config, int threads_number) {
+    if (name == "library" || name == "library-adaptive") {
+        Library lock(false, WaitMode::adaptive);
+        return measure_lock(name, lock, config, threads_number);
+    }
+    if (name == "library-park") {
+        Library lock(false, WaitMode::park);
+        return measure_lock(name, lock, config, threads_number);
+    }
+    if (name == "library-spin") {
+        Library lock(false, WaitMode::spin);
+        return measure_lock(name, lock, config, threads_number);
+    }
+    if (name == "futex") {
+        FutexRwLock lock;
+        return measure_lock(name, lock, config, threads_number);
+    }
+    throw std::invalid_argument("unknown lock: " + name);
+}
+
+std::vector<std::string> split_list(const std::string& list) {
+    std::vector<std::string> items;
+    std::size_t begin = 0;
+    while (begin <= list.size()) {
+        std::size_t end = list.find(',', begin);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        items.push_back(list.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return items;
+}
+
+BenchmarkConfig parse_benchmark_config(int argc, char* argv[]) {
+    BenchmarkConfig config;
+
+    for (int i = 2; i < argc; i += 2) {
+        std::string option = argv[i];
+        if (i + 1 >= argc) {
+            throw std::invalid_argument("missing value for " + option);
+        }
+        std::string value = argv[i + 1];
+
+        if (option == "--lock") {
+            config.locks = split_list(value);
+        } else if (option == "--threads") {
+            config.threads.clear();
+            for (const auto& item : split_list(value)) {
+                config.threads.push_back(std::stoi(item));
+            }
+        } else if (option == "--read-ratio") {
+            config.read_ratio = std::stod(value);
+        } else if (option == "--cs-ns") {
+            config.critical_section = std::chrono::nanoseconds(std::stoll(value));
+        } else if (option == "--think-ns") {
+            config.think_time = std::chrono::nanoseconds(std::stoll(value));
+        } else if (option == "--duration-ms") {
+            config.duration_ms = std::stoi(value);
+        } else if (option == "--format") {
+            config.format = value;
+        } else {
+            throw std::invalid_argument("unknown option: " + option);
+        }
+    }
+
+    if (config.threads.empty() || *std::min_element(config.threads.begin(), config.threads.end()) < 1) {
+        throw std::invalid_argument("--threads must list counts of at least 1");
+    }
+    if (config.duration_ms <= 0) {
+        throw std::invalid_argument("--duration-ms must be positive");
+    }
+    if (config.read_ratio < 0.0 || config.read_ratio > 1.0) {
+        throw std::invalid_argument("--read-ratio must be in [0, 1]");
+    }
+    if (config.format != "json" && config.format != "csv") {
+        throw std::invalid_argument("--format must be json or csv");
+    }
+    return config;
+}
+
+void run_benchmark(const BenchmarkConfig& config) {
+    bool header = true;
+    for (const auto& lock : config.locks) {
+        for (int threads_number : config.threads) {
+            print_report(measure_named_lock(lock, config, threads_number), config, header);
+            header = false;
+        }
+    }
+}
+
+void benchmark_deadlines(int threads_number, int duration_ms) {
+    constexpr double read_ratio = 0.5;
+    constexpr std::chrono::microseconds hold{100};
+    constexpr std::chrono::microseconds timeout{500};
+
+    for (bool timed : {false, true}) {
+        Library library(false);
+        std::vector<LatencyHistogram> latency(threads_number);
+        std::vector<long long> timeouts(threads_number, 0);
+
+        auto attempt = [&](int id, bool write) {
+            auto start = std::chrono::steady_clock::now();
+            bool acquired = true;
+            if (!timed) {
+                write ? library.start_write(id) : library.start_read(id);
+            } else {
+                acquired = write ? library.start_write_until(id, start + timeout) : library.start_read_until(id, start + timeout);
+            }
+            latency[id].record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+            if (!acquired) {
+                timeouts[id]++;
+                return;
+            }
+            busy_wait(hold);
+            write ? library.end_write(id) : library.end_read(id);
+        };
+
+        auto result = LockBenchmark::run(threads_number, read_ratio, duration_ms,
+            [&](int id, std::mt19937&) {
+                attempt(id, false);
+                return 0;
+            },
+            [&](int id, std::mt19937&) {
+                attempt(id, true);
+            });
+
+        for (int i = 1; i < threads_number; ++i) {
+            latency[0].merge(latency[i]);
+            timeouts[0] += timeouts[i];
+        }
+
+        std::cout << std::format("{:<22} | threads: {} | attempts: {} | timeouts: {} | p50: {} ns | p99: {} ns | p99.9: {} ns\n",
+                                 timed ? "start_*_until(500 us)" : "start_* (unbounded)", threads_number,
+                                 result.reads + result.writes, timeouts[0], latency[0].percentile(50.0),
+                                 latency[0].percentile(99.0), latency[0].percentile(99.9));
+    }
+}
+
+void benchmark_upgrade(int threads_number, int duration_ms) {
+    constexpr double transaction_ratio = 0.5;
+    constexpr std::chrono::nanoseconds decide{2000};
+    constexpr std::chrono::nanoseconds hold{1000};
+
+    for (bool upgradeable : {false, true}) {
+        Library library(false);
+        long long version = 0;
+        std::vector<long long> retries(threads_number, 0);
+
+        auto result = LockBenchmark::run(threads_number, transaction_ratio, duration_ms,
+            [&](int id, std::mt19937&) {
+                if (upgradeable) {
+                    library.start_upgradeable_read(id);
+                    busy_wait(decide);
+                    library.upgrade(id);
+                    version++;
+                    library.end_write(id);
+                    return 0;
+                }
+
+                while (true) {
+                    library.start_read(id);
+                    long long seen = version;
+                    busy_wait(decide);
+                    library.end_read(id);
+
+                    library.start_write(id);
+                    if (version == seen) {
+                        version++;
+                        library.end_write(id);
+                        return 0;
+                    }
+                    library.end_write(id);
+                    retries[id]++;
+                }
+            },
+            [&](int id, std::mt19937&) {
+                library.start_write(id);
+                busy_wait(hold);
+                version++;
+                library.end_write(id);
+            });
+
+        long long total_retries = std::accumulate(retries.begin(), retries.end(), 0LL);
+        std::cout << std::format("{:<28} | threads: {} | {:.0f} read-decide-write/s | retries per transaction: {:.3f} | {:.0f} plain writes/s\n",
+                                 upgradeable ? "upgradeable read + upgrade" : "end_read + start_write", threads_number,
+                                 result.reads / result.seconds, static_cast<double>(total_retries) / std::max(1LL, result.reads),
+                                 result.writes / result.seconds);
+    }
+}
+
+DetachedTask async_client(AsyncLibrary& library, boost::asio::thread_pool& executor, std::vector<int>& table,
+                          int id, int operations, std::atomic<long long>& writes, std::atomic<long long>& checksum_total,
+                          std::latch& done) {
+    std::mt19937 gen(id);
+    std::bernoulli_distribution is_read(0.9);
+    long long checksum = 0;
+
+    for (int i = 0; i < operations; ++i) {
+        co_await Reschedule(executor);
+
+        int key = gen() % static_cast<int>(table.size());
+        if (is_read(gen)) {
+            co_await library.read();
+            checksum += table[key];
+            library.end_read();
+        } else {
+            co_await library.write();
+            table[key] = id;
+            library.end_write();
+            writes.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    checksum_total.fetch_add(checksum, std::memory_order_relaxed);
+    done.count_down();
+}
+
+void benchmark_async(int tasks_number, int operations_per_task, int pool_threads) {
+    boost::asio::thread_pool executor(pool_threads);
+    AsyncLibrary library(executor);
+    std::vector<int> table(1024, 0);
+    std::atomic<long long> writes{0};
+    std::atomic<long long> checksum{0};
+    std::latch done(tasks_number);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < tasks_number; ++i) {
+        boost::asio::post(executor, [&, i] {
+            async_client(library, executor, table, i, operations_per_task, writes, checksum, done);
+        });
+    }
+    done.wait();
+    auto end = std::chrono::steady_clock::now();
+    executor.join();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    long long operations = static_cast<long long>(tasks_number) * operations_per_task;
+    std::cout << std::format("AsyncLibrary | coroutines: {} | pool threads: {} | operations: {} (writes: {}) | {:.3f} s | {:.0f} ops/s\n",
+                             tasks_number, pool_threads, operations, writes.load(), seconds, operations / seconds);
+}
+
+void benchmark_flat_combining(int readers_number, int duration_ms) {
+    constexpr std::chrono::nanoseconds hold{200};
+
+    for (int writers_number : {1, 2, 4, 8, 16, 32}) {
+        for (bool combining : {false, true}) {
+            Library library(false);
+            std::vector<long long> table(64, 0);
+            int threads_number = readers_number + writers_number;
+            double read_ratio = static_cast<double>(readers_number) / threads_number;
+
+            auto result = LockBenchmark::run(threads_number, read_ratio, duration_ms,
+                [&](int id, std::mt19937& gen) {
+                    library.start_read(id);
+                    long long value = table[gen() % table.size()];
+                    library.end_read(id);
+                    return static_cast<int>(value);
+                },
+                [&](int id, std::mt19937& gen) {
+                    std::size_t key = gen() % table.size();
+                    auto update = [&] {
+                        busy_wait(hold);
+                        table[key]++;
+                    };
+
+                    if (combining) {
+                        library.combine_write(id, update);
+                    } else {
+                        library.start_write(id);
+                        update();
+                        library.end_write(id);
+                    }
+                });
+
+            std::cout << std::format("Writers: {:>2} | {:<14} | {:.0f} writes/s | {:.0f} reads/s | average batch: {:.2f}\n",
+                                     writers_number, combining ? "flat combining" : "one at a time",
+                                     result.writes / result.seconds, result.reads / result.seconds,
+                                     combining ? library.average_combined_batch() : 1.0);
+        }
+    }
+}
+
+void benchmark_mvcc(int readers_number, int duration_ms) {
+    constexpr std::size_t table_size = 65536;
+    constexpr std::chrono::microseconds long_write{2000};
+    constexpr int updates_per_write = 100;
+
+    auto run = [&](const std::string& name, auto read_entry, auto long_update) {
+        std::vector<LatencyHistogram> latency(readers_number);
+        long long writes = 0;
+
+        BenchmarkResult result;
+        {
+            std::jthread writer([&](std::stop_token stop) {
+                std::mt19937 gen(readers_number + 1);
+                while (!stop.stop_requested()) {
+                    long_update(gen);
+                    writes++;
+                }
+            });
+
+            result = LockBenchmark::run(readers_number, 1.0, duration_ms,
+                [&](int id, std::mt19937& gen) {
+                    std::size_t key = gen() % table_size;
+                    auto start = std::chrono::steady_clock::now();
+                    int value = read_entry(id, key);
+                    latency[id].record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+                    return value;
+                },
+                [](int, std::mt19937&) {});
+        }
+
+        for (int i = 1; i < readers_number; ++i) {
+            latency[0].merge(latency[i]);
+        }
+        std::cout << std::format("{:<20} | readers: {} | {:.0f} reads/s | long writes: {} | read p50: {} ns | p99: {} ns | p99.9: {} ns\n",
+                                 name, readers_number, result.reads / result.seconds, writes, latency[0].percentile(50.0),
+                                 latency[0].percentile(99.0), latency[0].percentile(99.9));
+    };
+
+    {
+        Library library(false);
+        std::vector<int> table(table_size, 0);
+        int writer_id = readers_number;
+
+        run("Library",
+            [&](int id, std::size_t key) {
+                library.start_read(id);
+                int value = table[key];
+                library.end_read(id);
+                return value;
+            },
+            [&](std::mt19937& gen) {
+                library.start_write(writer_id);
+                busy_wait(long_write);
+                for (int i = 0; i < updates_per_write; ++i) {
+                    table[gen() % table_size]++;
+                }
+                library.end_write(writer_id);
+            });
+    }
+
+    {
+        VersionedTable<int> table(table_size);
+
+        run("VersionedTable",
+            [&](int, std::size_t key) {
+                return table.snapshot()[key];
+            },
+            [&](std::mt19937& gen) {
+                table.update([&](VersionedTable<int>::Transaction& transaction) {
+                    busy_wait(long_write);
+                    for (int i = 0; i < updates_per_write; ++i) {
+                        std::size_t key = gen() % table_size;
+                        transaction.set(key, transaction[key] + 1);
+                    }
+                });
+            });
+        std::cout << std::format("VersionedTable live versions after the run: {}\n", table.live_versions());
+    }
+}
+
+void benchmark_hash_map(int max_threads, int duration_ms) {
+    constexpr std::uint64_t key_space = 1 << 20;
+    constexpr int batch_size = 16;
+
+    for (int read_percent : {100, 90, 50}) {
+        for (int threads_number = 1; threads_number <= max_threads; threads_number *= 2) {
+            for (bool batched : {false, true}) {
+                ShardedHashMap<std::uint64_t, std::uint64_t> map;
+                for (std::uint64_t key = 0; key < key_space; key += 2) {
+                    map.insert_or_assign(key, key);
+                }
+
+                auto result = LockBenchmark::run(threads_number, read_percent / 100.0, duration_ms,
+                    [&](int, std::mt19937& gen) {
+                        if (!batched) {
+                            return static_cast<int>(map.find(gen() % key_space).has_value());
+                        }
+
+                        std::array<std::uint64_t, batch_size> keys;
+                        std::array<std::optional<std::uint64_t>, batch_size> values;
+                        for (auto& key : keys) {
+                            key = gen() % key_space;
+                        }
+                        map.find_batch(keys, values);
+                        return static_cast<int>(std::count_if(values.begin(), values.end(), [](const auto& v) { return v.has_value(); }));
+                    },
+                    [&](int id, std::mt19937& gen) {
+                        if (!batched) {
+                            map.insert_or_assign(gen() % key_space, id);
+                            return;
+                        }
+
+                        std::array<std::pair<std::uint64_t, std::uint64_t>, batch_size> entries;
+                        for (auto& entry : entries) {
+                            entry = {gen() % key_space, static_cast<std::uint64_t>(id)};
+                        }
+                        map.insert_batch(entries);
+                    });
+
+                int keys_per_operation = batched ? batch_size : 1;
+                std::cout << std::format("ShardedHashMap | read:write {}:{} | threads: {:>2} | {:<8} | {:.0f} lookups/s | {:.0f} inserts/s | size: {}\n",
+                                         read_percent, 100 - read_percent, threads_number, batched ? "batch 16" : "single",
+                                         keys_per_operation * result.reads / result.seconds,
+                                         keys_per_operation * result.writes / result.seconds, map.size());
+            }
+        }
+    }
+}
+
+struct VirtualRun {
+    LibraryScenario scenario;
+    VirtualLibrary::RoleStats reads;
+    VirtualLibrary::RoleStats writes;
+    long long events;
+};
+
+VirtualRun simulate_virtual(const LibraryScenario& scenario, std::chrono::seconds duration) {
+    EventLoop loop;
+    VirtualLibrary library(loop);
+
+    for (int i = 0; i < scenario.readers_number; ++i) {
+        loop.spawn(virtual_reader(loop, library, scenario, 2 * i + 1));
+    }
+    for (int i = 0; i < scenario.writers_number; ++i) {
+        loop.spawn(virtual_writer(loop, library, scenario, 2 * i + 2));
+    }
+
+    loop.run_until(duration);
+    return {scenario, library.reads(), library.writes(), loop.processed()};
+}
+
+void sweep_virtual(std::chrono::seconds duration) {
+    std::vector<LibraryScenario> scenarios;
+    for (int readers_number : {1, 3, 10, 30}) {
+        for (int writers_number : {1, 3, 9}) {
+            for (int read_ms : {100, 400}) {
+                LibraryScenario scenario;
+                scenario.readers_number = readers_number;
+                scenario.writers_number = writers_number;
+                scenario.read_time = std::chrono::milliseconds(read_ms);
+                scenarios.push_back(scenario);
+            }
+        }
+    }
+
+    std::vector<VirtualRun> runs(scenarios.size());
+    std::atomic<std::size_t> next{0};
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::jthread> workers;
+        for (unsigned t = 0; t < std::max(1u, std::thread::hardware_concurrency()); ++t) {
+            workers.emplace_back([&] {
+                for (std::size_t i = next++; i < scenarios.size(); i = next++) {
+                    runs[i] = simulate_virtual(scenarios[i], duration);
+                }
+            });
+        }
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (const auto& run : runs) {
+        std::cout << std::format("readers: {:>2} | writers: {} | read: {:>3} ms | reads: {:>7} (wait avg {:>9.1f} ms, max {:>9.1f} ms) | writes: {:>6} (wait avg {:>7.1f} ms, max {:>7.1f} ms) | events: {}\n",
+                                 run.scenario.readers_number, run.scenario.writers_number, run.scenario.read_time.count(),
+                                 run.reads.acquisitions, run.reads.average_wait_ms(),
+                                 std::chrono::duration<double, std::milli>(run.reads.max_wait).count(),
+                                 run.writes.acquisitions, run.writes.average_wait_ms(),
+                                 std::chrono::duration<double, std::milli>(run.writes.max_wait).count(), run.events);
+    }
+    std::cout << std::format("{} scenarios x {} s of virtual time simulated in {:.3f} s\n", runs.size(), duration.count(), elapsed);
+}
+
+struct alignas(64) ProcessCounters {
+    std::uint64_t reads;
+    std::uint64_t writes;
+    std::uint64_t checksum;
+};
+
+struct SharedCache {
+    SharedRwLock lock;
+    std::atomic<bool> start;
+    alignas(64) std::array<std::uint64_t, 512> values;
+    std::array<ProcessCounters, 64> counters;
+};
+
+void shared_cache_client(SharedCache& cache, int index, bool writer, std::chrono::milliseconds duration) {
+    while (!cache.start.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+
+    std::mt19937 gen(index);
+    ProcessCounters counters{};
+    auto deadline = std::chrono::steady_clock::now() + duration;
+
+    while (std::chrono::steady_clock::now() < deadline) {
+        for (int i = 0; i < 64; ++i) {
+            std::size_t slot = gen() % (cache.values.size() - 8);
+            if (writer) {
+                cache.lock.lock();
+                cache.values[slot]++;
+                cache.lock.unlock();
+                counters.writes++;
+            } else {
+                cache.lock.lock_shared();
+                for (std::size_t j = slot; j < slot + 8; ++j) {
+                    counters.checksum += cache.values[j];
+                }
+                cache.lock.unlock_shared();
+                counters.reads++;
+            }
+        }
+    }
+
+    cache.counters[index] = counters;
+}
+
+void benchmark_shared_lock(int max_processes, std::chrono::milliseconds duration) {
+    SharedMemory segment(std::format("/readers_writers_{}", getpid()), sizeof(SharedCache));
+    SharedCache* cache = segment.construct<SharedCache>();
+
+    for (bool with_writer : {false, true}) {
+        for (int readers_number = 1; readers_number <= max_processes; readers_number *= 2) {
+            int processes = readers_number + with_writer;
+            cache->start.store(false);
+            cache->counters = {};
+
+            std::vector<pid_t> children;
+            for (int i = 0; i < processes; ++i) {
+                pid_t pid = fork();
+                if (pid == 0) {
+                    shared_cache_client(*cache, i, i == readers_number, duration);
+                    _exit(0);
+                }
+                children.push_back(pid);
+            }
+
+            cache->start.store(true, std::memory_order_release);
+            for (pid_t child : children) {
+                waitpid(child, nullptr, 0);
+            }
+
+            std::uint64_t reads = 0;
+            std::uint64_t writes = 0;
+            for (int i = 0; i < processes; ++i) {
+                reads += cache->counters[i].reads;
+                writes += cache->counters[i].writes;
+            }
+
+            double seconds = std::chrono::duration<double>(duration).count();
+            std::cout << std::format("SharedRwLock | reader processes: {:>2} | writer process: {:<3} | {:.0f} reads/s | {:.0f} writes/s\n",
+                                     readers_number, with_writer ? "yes" : "no", reads / seconds, writes / seconds);
+        }
+    }
+
+    pid_t crashed = fork();
+    if (crashed == 0) {
+        cache->lock.lock();
+        _exit(1);
+    }
+    waitpid(crashed, nullptr, 0);
+
+    auto start = std::chrono::steady_clock::now();
+    cache->lock.lock_shared();
+    cache->lock.unlock_shared();
+    auto recovery = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << std::format("Writer process {} exited holding the lock; recovered in {:.1f} ms (recoveries: {})\n",
+                             crashed, recovery, cache->lock.recoveries());
+}
+
+template<typename Lock>
+BenchmarkResult measure_numa_lock(Lock& lock, int threads_number, double read_ratio, int duration_ms) {
+    const NumaTopology& topology = NumaTopology::system();
+    std::array<std::uint64_t, 64> data{};
+
+    auto pin = [&](int id) {
+        thread_local bool pinned = false;
+        if (!pinned) {
+            topology.pin_current_thread(id % topology.nodes());
+            pinned = true;
+        }
+    };
+
+    return LockBenchmark::run(threads_number, read_ratio, duration_ms,
+        [&](int id, std::mt19937&) {
+            pin(id);
+            read_lock(lock, id);
+            int sum = static_cast<int>(std::accumulate(data.begin(), data.end(), std::uint64_t{0}));
+            read_unlock(lock, id);
+            return sum;
+        },
+        [&](int id, std::mt19937&) {
+            pin(id);
+            write_lock(lock, id);
+            for (auto& value : data) {
+                value++;
+            }
+            write_unlock(lock, id);
+        });
+}
+
+void benchmark_numa(int threads_number, int duration_ms) {
+    const NumaTopology& topology = NumaTopology::system();
+    std::cout << std::format("NUMA nodes: {}{}\n", topology.nodes(), topology.is_virtual() ? " (virtual, single-node machine)" : "");
+
+    for (int read_percent : {0, 50, 90, 99}) {
+        double read_ratio = read_percent / 100.0;
+        auto print = [&](const std::string& name, const BenchmarkResult& result) {
+            std::cout << std::format("{:<16} | read:write {}:{} | threads: {} | {:>10.0f} reads/s | {:>10.0f} writes/s | fairness: {:.3f}",
+                                     name, read_percent, 100 - read_percent, threads_number,
+                                     result.reads / result.seconds, result.writes / result.seconds, LockBenchmark::fairness(result));
+        };
+
+        {
+            Library library(false);
+            print("library", measure_numa_lock(library, threads_number, read_ratio, duration_ms));
+            std::cout << "\n";
+        }
+        {
+            FutexRwLock lock;
+            print("futex", measure_numa_lock(lock, threads_number, read_ratio, duration_ms));
+            std::cout << "\n";
+        }
+        for (int max_batch : {1, 64}) {
+            CohortRwLock lock(topology.nodes(), max_batch);
+            print(std::format("cohort batch {}", max_batch), measure_numa_lock(lock, threads_number, read_ratio, duration_ms));
+            std::cout << std::format(" | writes per migration: {:.1f}\n", lock.average_batch());
+        }
+    }
+}
+
+void benchmark_left_right(int threads_number, int duration_ms) {
+    constexpr std::size_t table_size = 1024;
+    using Table = std::array<std::uint64_t, table_size>;
+
+    auto run = [&](const std::string& name, int read_percent, auto read_entry, auto write_entry) {
+        std::vector<LatencyHistogram> latency(threads_number);
+
+        auto result = LockBenchmark::run(threads_number, read_percent / 100.0, duration_ms,
+            [&](int id, std::mt19937& gen) {
+                std::size_t key = gen() % (table_size - 8);
+                auto start = std::chrono::steady_clock::now();
+                int value = read_entry(id, key);
+                latency[id].record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+                return value;
+            },
+            [&](int id, std::mt19937& gen) {
+                write_entry(id, gen() % table_size);
+            });
+
+        for (int i = 1; i < threads_number; ++i) {
+            latency[0].merge(latency[i]);
+        }
+        std::cout << std::format("{:<10} | read:write {}:{} | threads: {} | {:>10.0f} reads/s | {:>9.0f} writes/s | read p50: {} ns | p99: {} ns | p99.9: {} ns\n",
+                                 name, read_percent, 100 - read_percent, threads_number, result.reads / result.seconds,
+                                 result.writes / result.seconds, latency[0].percentile(50.0), latency[0].percentile(99.0),
+                                 latency[0].percentile(99.9));
+    };
+
+    auto sum = [](const Table& table, std::size_t key) {
+        return static_cast<int>(std::accumulate(table.begin() + key, table.begin() + key + 8, std::uint64_t{0}));
+    };
+
+    for (int read_percent : {90, 99, 100}) {
+        {
+            Library library(false);
+            Table table{};
+
+            run("Library", read_percent,
+                [&](int id, std::size_t key) {
+                    library.start_read(id);
+                    int value = sum(table, key);
+                    library.end_read(id);
+                    return value;
+                },
+                [&](int id, std::size_t key) {
+                    library.start_write(id);
+                    table[key]++;
+                    library.end_write(id);
+                });
+        }
+
+        {
+            LeftRight<Table> table;
+
+            run("LeftRight", read_percent,
+                [&](int, std::size_t key) {
+                    return table.read([&](const Table& t) {
+                        return sum(t, key);
+                    });
+                },
+                [&](int, std::size_t key) {
+                    table.write([key](Table& t) {
+                        t[key]++;
+                    });
+                });
+        }
+    }
+}
+
+void benchmark_priorities(int readers_number, int duration_ms) {
+    struct WriterClass {
+        WritePriority priority;
+        const char* name;
+        int threads;
+        std::chrono::microseconds hold;
+    };
+    const WriterClass classes[] = {
+        {WritePriority::critical, "critical", 1, std::chrono::microseconds(20)},
+        {WritePriority::normal, "normal", 4, std::chrono::microseconds(100)},
+        {WritePriority::bulk, "bulk", 2, std::chrono::microseconds(300)},
+    };
+
+    for (bool ordered : {false, true}) {
+        Library library(false);
+        std::array<LatencyHistogram, 3> write_latency;
+        std::array<std::mutex, 3> write_latency_mutex;
+        std::vector<LatencyHistogram> read_latency(readers_number);
+
+        {
+            std::vector<std::jthread> threads;
+            for (int i = 0; i < readers_number; ++i) {
+                threads.emplace_back([&, i](std::stop_token stop) {
+                    while (!stop.stop_requested()) {
+                        auto start = std::chrono::steady_clock::now();
+                        library.start_read(i);
+                        read_latency[i].record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+                        busy_wait(std::chrono::microseconds(5));
+                        library.end_read(i);
+                    }
+                });
+            }
+
+            int id = readers_number;
+            for (const auto& writer_class : classes) {
+                for (int t = 0; t < writer_class.threads; ++t) {
+                    threads.emplace_back([&, writer_class, id = id++](std::stop_token stop) {
+                        int index = static_cast<int>(writer_class.priority);
+                        WritePriority priority = ordered ? writer_class.priority : WritePriority::normal;
+                        LatencyHistogram local;
+
+                        while (!stop.stop_requested()) {
+                            std::this_thread::sleep_for(std::chrono::microseconds(200));
+                            auto start = std::chrono::steady_clock::now();
+                            library.start_write(id, priority);
+                            local.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+                            std::this_thread::sleep_for(writer_class.hold);
+                            library.end_write(id);
+                        }
+
+                        std::scoped_lock lock(write_latency_mutex[index]);
+                        write_latency[index].merge(local);
+                    });
+                }
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(duration_ms));
+            for (auto& thread : threads) {
+                thread.request_stop();
+            }
+        }
+
+        for (int i = 1; i < readers_number; ++i) {
+            read_latency[0].merge(read_latency[i]);
+        }
+
+        std::cout << std::format("Writer admission: {}\n", ordered ? "earliest due (priority classes)" : "single class (FIFO)");
+        auto print = [](const char* name, const LatencyHistogram& histogram) {
+            std::cout << std::format("  {:<8} | acquisitions: {:>8} | wait p50: {:>9} ns | p99: {:>10} ns | p99.9: {:>10} ns\n",
+                                     name, histogram.count(), histogram.percentile(50.0), histogram.percentile(99.0), histogram.percentile(99.9));
+        };
+        for (const auto& writer_class : classes) {
+            print(writer_class.name, write_latency[static_cast<int>(writer_class.priority)]);
+        }
+        print("readers", read_latency[0]);
+    }
+}
+
+void benchmark_logging(int threads_number, int messages_per_thread) {
+    struct NullBuffer : std::streambuf {
+        int overflow(int c) override {
+            return c;
+        }
+    } null_buffer;
+    std::ostream null_sink(&null_buffer);
+
+    for (auto overflow : {AsyncLogger::Overflow::drop, AsyncLogger::Overflow::block}) {
+        AsyncLogger logger(null_sink, 4096, overflow);
+        std::vector<LatencyHistogram> latency(threads_number);
+
+        auto start = std::chrono::steady_clock::now();
+        {
+            std::vector<std::jthread> threads;
+            for (int t = 0; t < threads_number; ++t) {
+                threads.emplace_back([&, t] {
+                    for (int i = 0; i < messages_per_thread; ++i) {
+                        auto before = std::chrono::steady_clock::now();
+                        logger.log("Reader {} starts reading (readers = {}, writers = {})", t, i, 0);
+                        latency[t].record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - before).count());
+                    }
+                });
+            }
+        }
+        logger.flush();
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        for (int t = 1; t < threads_number; ++t) {
+            latency[0].merge(latency[t]);
+        }
+        std::cout << std::format("AsyncLogger | overflow: {:<5} | threads: {} | {:.0f} messages/s | dropped: {} | call p50: {} ns | p99: {} ns | p99.9: {} ns\n",
+                                 overflow == AsyncLogger::Overflow::drop ? "drop" : "block", threads_number,
+                                 threads_number * messages_per_thread / seconds, logger.dropped(),
+                                 latency[0].percentile(50.0), latency[0].percentile(99.0), latency[0].percentile(99.9));
+    }
+}
+
+int main(int argc, char* argv[]) {
+
+    std::string mode = argc > 1 ? argv[1] : "simulate";
+
+    if (mode == "bench") {
+        try {
+            run_benchmark(parse_benchmark_config(argc, argv));
+        } catch (const std::exception& e) {
+            std::cerr << std::format("bench: {}\n", e.what());
+            std::cerr << "usage: readers_writers bench [--lock library,library-park,library-spin,futex] [--threads 1,2,4]\n"
+                         "                             [--read-ratio 0.9] [--cs-ns 100] [--think-ns 0]\n"
+                         "                             [--duration-ms 2000] [--format json|csv]\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    if (mode == "rcu") {
+        int threads_number = std::max(4u, std::thread::hardware_concurrency());
+        int duration_ms = 2000;
+
+        benchmark_rcu(threads_number, duration_ms);
+        return 0;
+    }
+
+    if (mode == "handoff") {
+        int duration_ms = 1000;
+
+        benchmark_writer_handoff(duration_ms);
+        return 0;
+    }
+
+    if (mode == "spin") {
+        int threads_number = std::max(4u, std::thread::hardware_concurrency());
+        int duration_ms = 500;
+
+        benchmark_wait_modes(threads_number, duration_ms);
+        return 0;
+    }
+
+    if (mode == "shutdown") {
+        int readers_number = 30;
+        int writers_number = 30;
+        int duration_time = 2;
+
+        Library library(false);
+        auto shutdown = library.simulate(readers_number, writers_number, duration_time);
+        std::cout << std::format("Readers: {}, writers: {} | shutdown latency: {} us\n", readers_number, writers_number, shutdown.count());
+        return 0;
+    }
+
+    if (mode == "logging") {
+        int threads_number = std::max(4u, std::thread::hardware_concurrency());
+        int messages_per_thread = 250000;
+
+        benchmark_logging(threads_number, messages_per_thread);
+        return 0;
+    }
+
+    if (mode == "priority") {
+        int readers_number = std::max(4u, std::thread::hardware_concurrency());
+        int duration_ms = 2000;
+
+        benchmark_priorities(readers_number, duration_ms);
+        return 0;
+    }
+
+    if (mode == "leftright") {
+        int threads_number = std::max(4u, std::thread::hardware_concurrency());
+        int duration_ms = 1000;
+
+        benchmark_left_right(threads_number, duration_ms);
+        return 0;
+    }
+
+    if (mode == "numa") {
+        int threads_number = std::max(8u, std::thread::hardware_concurrency());
+        int duration_ms = 1000;
+
+        benchmark_numa(threads_number, duration_ms);
+        return 0;
+    }
+
+    if (mode == "shared") {
+        int max_processes = std::max(4u, std::thread::hardware_concurrency());
+        std::chrono::milliseconds duration(500);
+
+        benchmark_shared_lock(max_processes, duration);
+        return 0;
+    }
+
+    if (mode == "virtual") {
+        std::chrono::hours duration(1);
+
+        sweep_virtual(duration);
+        return 0;
+    }
+
+    if (mode == "hashmap") {
+        int max_threads = std::max(4u, 2 * std::thread::hardware_concurrency());
+        int duration_ms = 500;
+
+        benchmark_hash_map(max_threads, duration_ms);
+        return 0;
+    }
+
+    if (mode == "mvcc") {
+        int readers_number = std::max(3u, std::thread::hardware_concurrency());
+        int duration_ms = 2000;
+
+        benchmark_mvcc(readers_number, duration_ms);
+        return 0;
+    }
+
+    if (mode == "combining") {
+        int readers_number = 3;
+        int duration_ms = 1000;
+
+        benchmark_flat_combining(readers_number, duration_ms);
+        return 0;
+    }
+
+    if (mode == "async") {
+        int tasks_number = 100000;
+        int operations_per_task = 10;
+        int pool_threads = std::max(2u, std::thread::hardware_concurrency());
+
+        benchmark_async(tasks_number, operations_per_task, pool_threads);
+        return 0;
+    }
+
+    if (mode == "upgrade") {
+        int threads_number = std::max(4u, std::thread::hardware_concurrency());
+        int duration_ms = 2000;
+
+        benchmark_upgrade(threads_number, duration_ms);
+        return 0;
+    }
+
+    if (mode == "deadline") {
+        int threads_number = std::max(16u, 4 * std::thread::hardware_concurrency());
+        int duration_ms = 2000;
+
+        benchmark_deadlines(threads_number, duration_ms);
+        return 0;
+    }
+
+    if (mode == "futex") {
+        int threads_number = std::max(4u, std::thread::hardware_concurrency());
+        BenchmarkConfig config;
+
+        for (const std::string lock : {"library", "futex"}) {
+            auto report = measure_named_lock(lock, config, threads_number);
+            LockBenchmark::print(lock, static_cast<int>(config.read_ratio * 100), threads_number, report.result);
+            report.read_latency.print(lock + " read acquisition");
+            report.write_latency.print(lock + " write acquisition");
+            std::cout << "\n";
+        }
+        return 0;
+    }
 
     Library library; 
-    int readers_number = 3; 
-    int writers_number = 9;
+    int readers_number = LibraryScenario{}.readers_number; 
+    int writers_number = LibraryScenario{}.writers_number;
     int duration_time = 15; 
     
     library.simulate(readers_number, writers_number, duration_time); 